@@ -0,0 +1,21 @@
+# add_scheme_executable(<name> <source.scm>)
+#
+# Compiles a Scheme program to C++ with scheme2cxx and builds it into an
+# executable linked against the runtime. The program prints exactly what the
+# interpreter would print for the same input.
+function(add_scheme_executable name source)
+    get_filename_component(source_path ${source} ABSOLUTE)
+    set(generated ${CMAKE_CURRENT_BINARY_DIR}/${name}.scm.cpp)
+    add_custom_command(
+        OUTPUT ${generated}
+        COMMAND scheme2cxx ${source_path} ${generated}
+        DEPENDS scheme2cxx ${source_path}
+        COMMENT "Compiling Scheme program ${source} to C++"
+    )
+    add_executable(${name} ${generated})
+    target_link_libraries(${name} scheme_runtime)
+    set_target_properties(${name} PROPERTIES
+        CXX_STANDARD 11
+        CXX_STANDARD_REQUIRED ON
+    )
+endfunction()
@@ -18,11 +18,16 @@
  * 
  * Categories:
  * - Arithmetic: +, -, *, /, modulo, expt
+ * - Number theory: quotient, remainder, gcd, lcm, exact-integer-sqrt, expt-mod, prime?
  * - Comparison: <, <=, =, >=, >
- * - List operations: cons, car, cdr, list, set-car!, set-cdr!
+ * - List operations: cons, car, cdr, list, set-car!, set-cdr!, member, assoc
+ * - List combinators: map, filter, fold
  * - Logic: not, and, or (and/or support short-circuit evaluation)
- * - Type predicates: eq?, boolean?, number?, null?, pair?, procedure?, symbol?, list?, string?
+ * - Type predicates: eq?, eqv?, equal?, boolean?, number?, null?, pair?, procedure?, symbol?, list?, string?
  * - I/O: display
+ * - Environment snapshots: checkpoint, rollback
+ * - Exceptions: raise, raise-continuable, error, with-exception-handler,
+ *   error-object?, error-object-message, error-object-irritants
  * - Control: void, exit
  */
 std::map<std::string, ExprType> primitives = {
@@ -33,6 +38,15 @@ std::map<std::string, ExprType> primitives = {
     {"/",        E_DIV},
     {"modulo",   E_MODULO},
     {"expt",     E_EXPT},
+
+    // Number theory
+    {"quotient",           E_QUOTIENT},
+    {"remainder",          E_REMAINDER},
+    {"gcd",                E_GCD},
+    {"lcm",                E_LCM},
+    {"exact-integer-sqrt", E_EXACT_INT_SQRT},
+    {"expt-mod",           E_EXPT_MOD},
+    {"prime?",             E_PRIMEQ},
     
     // Comparison operations
     {"<",        E_LT},
@@ -48,6 +62,13 @@ std::map<std::string, ExprType> primitives = {
     {"list",      E_LIST},
     {"set-car!",  E_SETCAR},
     {"set-cdr!",  E_SETCDR},
+    {"member",    E_MEMBER},
+    {"assoc",     E_ASSOC},
+
+    // List combinators
+    {"map",       E_MAP},
+    {"filter",    E_FILTER},
+    {"fold",      E_FOLD},
 
     // Logic operations
     {"not",       E_NOT},
@@ -56,6 +77,8 @@ std::map<std::string, ExprType> primitives = {
     
     // Type predicates
     {"eq?",        E_EQQ},
+    {"eqv?",       E_EQVQ},
+    {"equal?",     E_EQUALQ},
     {"boolean?",   E_BOOLQ},
     {"number?",    E_INTQ},      
     {"null?",      E_NULLQ},
@@ -67,6 +90,19 @@ std::map<std::string, ExprType> primitives = {
     
     // I/O operations
     {"display",   E_DISPLAY},
+
+    // Environment snapshots
+    {"checkpoint", E_CHECKPOINT},
+    {"rollback",   E_ROLLBACK},
+
+    // Exceptions
+    {"raise",                  E_RAISE},
+    {"raise-continuable",      E_RAISE_CONTINUABLE},
+    {"error",                  E_ERROR},
+    {"with-exception-handler", E_WITH_HANDLER},
+    {"error-object?",          E_ERRORQ},
+    {"error-object-message",   E_ERROR_MESSAGE},
+    {"error-object-irritants", E_ERROR_IRRITANTS},
     
     // Special values and control
     {"void",      E_VOID},
@@ -82,11 +118,12 @@ std::map<std::string, ExprType> primitives = {
  * 
  * Categories:
  * - Control flow constructs: begin, quote
- * - Conditional : if, cond
+ * - Conditional : if, cond, case
  * - Function definition: lambda
  * - Variable and function definition: define
  * - Binding constructs: let, letrec
  * - Assignment: set!
+ * - Exceptions: guard
  * 
  * Note: and/or have been moved to primitives to support function-style usage
  * while maintaining their short-circuit evaluation behavior.
@@ -99,6 +136,7 @@ std::map<std::string, ExprType> reserved_words = {
     // Conditional
     {"if",      E_IF},       
     {"cond",    E_COND},     
+    {"case",    E_CASE},
 
     // Function definition
     {"lambda",  E_LAMBDA},   
@@ -111,5 +149,8 @@ std::map<std::string, ExprType> reserved_words = {
     {"letrec",  E_LETREC},   
     
     // Assignment
-    {"set!",    E_SET}      
+    {"set!",    E_SET},
+
+    // Exceptions
+    {"guard",   E_GUARD}
 };
@@ -20,8 +20,10 @@
 struct Syntax;
 struct Expr;
 struct Value;
+struct ValueBase;
 struct AssocList;
 struct Assoc;
+struct ProcedureCode;
 
 /**
  * @brief Expression types enumeration
@@ -47,6 +49,15 @@ enum ExprType {
     E_MODULO,
     E_EXPT,
 
+    // Number theory
+    E_QUOTIENT,
+    E_REMAINDER,
+    E_GCD,
+    E_LCM,
+    E_EXACT_INT_SQRT,
+    E_EXPT_MOD,
+    E_PRIMEQ,
+
     // Comparison operations
     E_LT,              
     E_LE,             
@@ -61,6 +72,13 @@ enum ExprType {
     E_LIST,             
     E_SETCAR,          
     E_SETCDR,          
+    E_MEMBER,
+    E_ASSOC,
+
+    // List combinators
+    E_MAP,
+    E_FILTER,
+    E_FOLD,
 
     // Logic operations
     E_NOT,              
@@ -69,6 +87,8 @@ enum ExprType {
     
     // Type predicates
     E_EQQ,              
+    E_EQVQ,
+    E_EQUALQ,
     E_BOOLQ,           
     E_INTQ,            
     E_NULLQ,            
@@ -85,12 +105,15 @@ enum ExprType {
     //Conditional
     E_IF,             
     E_COND,            
+    E_CASE,
 
     // Variables and function definition
     E_VAR,              
     E_APPLY,           
     E_LAMBDA,         
     E_DEFINE,          
+    E_NATIVE,
+    E_LAZY_BODY,
 
     // Binding constructs
     E_LET,            
@@ -101,6 +124,29 @@ enum ExprType {
 
     // I/O operations
     E_DISPLAY,         
+
+    // Environment snapshots
+    E_CHECKPOINT,
+    E_ROLLBACK,
+
+    // Exceptions
+    E_RAISE,
+    E_RAISE_CONTINUABLE,
+    E_ERROR,
+    E_WITH_HANDLER,
+    E_ERRORQ,
+    E_ERROR_MESSAGE,
+    E_ERROR_IRRITANTS,
+    E_GUARD,
+
+    // Introduced by optimization passes
+    E_UNBOXED_ARITH,
+    E_UNBOXED_TEST,
+    E_MAKE_BOX,
+    E_BOX_REF,
+    E_BOX_SET,
+    E_LIST_PIPELINE,
+    E_CONSTANT,
 };
 
 /**
@@ -119,7 +165,9 @@ enum ValueType {
     V_PAIR,             
     V_PROC,             
     V_VOID,            
-    V_TERMINATE        
+    V_ERROR,
+    V_TERMINATE,
+    V_BOX               // Internal: cell of an assigned variable
 };
 
 #endif // DEF_HPP
@@ -1,5 +1,8 @@
 #include "RE.hpp"
 #include <cstring>
 
-RuntimeError::RuntimeError(std::string s1) : s(s1) {}
-std::string RuntimeError::message() const { return s; }
\ No newline at end of file
+RuntimeError::RuntimeError(const char *s1) : literal(s1) {}
+RuntimeError::RuntimeError(std::string s1) : literal(nullptr), s(s1) {}
+std::string RuntimeError::message() const { return literal ? std::string(literal) : s; }
+
+RaisedError::RaisedError(const std::shared_ptr<ValueBase> &v) : RuntimeError("Uncaught raise"), payload(v) {}
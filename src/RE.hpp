@@ -2,14 +2,26 @@
 #define RUNTIMEERROR
 
 #include <exception>
+#include <memory>
 #include <string>
 
+struct ValueBase;
+
 class RuntimeError : std::exception {
     private:
+        const char *literal;    // static message, avoids a heap allocation
         std::string s;
     public:
+        RuntimeError(const char *);
         RuntimeError(std::string);
         std::string message() const;
 };
 
-#endif
\ No newline at end of file
+// A Scheme object raised by raise, raise-continuable or error
+class RaisedError : public RuntimeError {
+    public:
+        std::shared_ptr<ValueBase> payload;
+        RaisedError(const std::shared_ptr<ValueBase> &);
+};
+
+#endif
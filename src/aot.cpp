@@ -0,0 +1,32 @@
+/**
+ * @file aot.cpp
+ * @brief Runtime support for programs compiled by scheme2cxx
+ */
+
+#include "aot.hpp"
+#include <iostream>
+#include <cstdio>
+
+bool aotRunForm(Value (*form)(Assoc &), Assoc &env) {
+    #ifndef ONLINE_JUDGE
+        std::cout << "scm> ";
+    #endif
+    try {
+        Value val = form(env);
+        if (val->v_type == V_TERMINATE) {
+            skipTeardown();
+            return false;
+        }
+        val->show(std::cout);
+    }
+    catch (const RuntimeError &RE) {
+        std::cout << "RuntimeError";
+    }
+    std::cout.flush();
+    puts("");
+    return true;
+}
+
+bool aotTruthy(const Value &v) {
+    return !(v->v_type == V_BOOL && static_cast<Boolean*>(v.get())->b == false);
+}
@@ -0,0 +1,29 @@
+#ifndef AOT_HPP
+#define AOT_HPP
+
+/**
+ * @file aot.hpp
+ * @brief Runtime support for programs compiled by scheme2cxx
+ *
+ * A compiled program is one C++ function per top-level form and per lambda.
+ * Its main() runs the forms in order through aotRunForm, which prints each
+ * result exactly as the REPL does.
+ */
+
+#include "Def.hpp"
+#include "value.hpp"
+#include "expr.hpp"
+#include "RE.hpp"
+
+/**
+ * @brief Run one compiled top-level form and print its result like the REPL
+ * @return false once the form evaluates to (exit)
+ */
+bool aotRunForm(Value (*)(Assoc &), Assoc &);
+
+/**
+ * @brief Scheme truthiness: everything except #f is true
+ */
+bool aotTruthy(const Value &);
+
+#endif // AOT_HPP
@@ -0,0 +1,155 @@
+/**
+ * @file batch.cpp
+ * @brief Whole-program analysis and the batch evaluation loop
+ */
+
+#include "batch.hpp"
+#include "expr.hpp"
+#include "value.hpp"
+#include "RE.hpp"
+#include "optimize.hpp"
+#include "pool.hpp"
+#include <iostream>
+#include <map>
+#include <cstdio>
+
+extern std::map<std::string, ExprType> primitives;
+extern std::map<std::string, ExprType> reserved_words;
+
+// ============================================================================
+// Whole-program analysis
+// ============================================================================
+
+namespace {
+
+struct ProgramScan {
+    std::map<std::string, int> definitions;     ///< Top-level defines per name
+    std::set<std::string> disqualified;         ///< Assigned, bound locally or defined in a nested form
+    bool snapshots;                             ///< Uses checkpoint or rollback
+
+    ProgramScan() : snapshots(false) {}
+
+    void binder(const Syntax &stx) {
+        if (SymbolSyntax *s = dynamic_cast<SymbolSyntax*>(stx.get())) disqualified.insert(s->s);
+    }
+
+    // Names bound by ((name init) ...); the inits are scanned as expressions
+    void bindings(const Syntax &stx) {
+        List *l = dynamic_cast<List*>(stx.get());
+        if (l == nullptr) return;
+        for (auto &b : l->stxs) {
+            List *pair = dynamic_cast<List*>(b.get());
+            if (pair == nullptr || pair->stxs.empty()) continue;
+            binder(pair->stxs[0]);
+            for (size_t i = 1; i < pair->stxs.size(); ++i) scan(pair->stxs[i], false);
+        }
+    }
+
+    void scan(const Syntax &stx, bool top) {
+        if (SymbolSyntax *s = dynamic_cast<SymbolSyntax*>(stx.get())) {
+            if (s->s == "checkpoint" || s->s == "rollback") snapshots = true;
+            return;
+        }
+        List *l = dynamic_cast<List*>(stx.get());
+        if (l == nullptr || l->stxs.empty()) return;
+        SymbolSyntax *head = dynamic_cast<SymbolSyntax*>(l->stxs[0].get());
+        const std::string op = head != nullptr ? head->s : "";
+        size_t rest = 1;
+        if (op == "quote") {
+            return;
+        } else if (op == "define" && l->stxs.size() > 1) {
+            if (SymbolSyntax *name = dynamic_cast<SymbolSyntax*>(l->stxs[1].get())) {
+                if (top) ++definitions[name->s];
+                else disqualified.insert(name->s);
+            }
+            rest = 2;
+        } else if (op == "set!" && l->stxs.size() > 1) {
+            binder(l->stxs[1]);
+            rest = 2;
+        } else if (op == "lambda" && l->stxs.size() > 1) {
+            if (List *params = dynamic_cast<List*>(l->stxs[1].get()))
+                for (auto &p : params->stxs) binder(p);
+            rest = 2;
+        } else if ((op == "let" || op == "letrec") && l->stxs.size() > 1) {
+            bindings(l->stxs[1]);
+            rest = 2;
+        } else if (op == "guard" && l->stxs.size() > 1) {
+            if (List *spec = dynamic_cast<List*>(l->stxs[1].get())) {
+                if (!spec->stxs.empty()) binder(spec->stxs[0]);
+                for (size_t i = 1; i < spec->stxs.size(); ++i) scan(spec->stxs[i], false);
+            }
+            rest = 2;
+        } else {
+            rest = 0;
+        }
+        for (size_t i = rest; i < l->stxs.size(); ++i) scan(l->stxs[i], false);
+    }
+};
+
+}
+
+std::set<std::string> finalGlobals(const std::vector<Syntax> &forms) {
+    ProgramScan scan;
+    for (auto &form : forms) scan.scan(form, true);
+    std::set<std::string> final_names;
+    if (scan.snapshots) return final_names;
+    for (auto &d : scan.definitions) {
+        const std::string &name = d.first;
+        if (d.second != 1 || scan.disqualified.count(name) != 0) continue;
+        if (primitives.count(name) != 0 || reserved_words.count(name) != 0) continue;
+        final_names.insert(name);
+    }
+    return final_names;
+}
+
+// ============================================================================
+// Batch loop
+// ============================================================================
+
+void runBatch(std::istream &is, bool regions) {
+    lazy_lambda_bodies = false;     // Substitution needs every body parsed
+    std::vector<Syntax> forms;
+    while (readSpace(is).peek() != EOF) forms.push_back(readSyntax(is));
+    std::set<std::string> final_names = finalGlobals(forms);
+
+    Assoc global_env = empty();
+    std::map<std::string, Value> known;     // Values of the final globals defined so far
+    for (auto &stx : forms) {
+        #ifndef ONLINE_JUDGE
+            std::cout << "scm> ";
+        #endif
+        std::cout.flush();      // As reading from the tied std::cin does in the REPL
+        try {
+            Expr expr = stx->parse(global_env);
+            substituteGlobals(expr, known);
+            optimize(expr, global_env);
+            if (regions) regionBegin();
+            Value val(nullptr);
+            Define *def = dynamic_cast<Define*>(expr.get());
+            if (def != nullptr && final_names.count(def->var) != 0) {
+                // Final: keep the value out of the environment
+                RegionPause pause;
+                val = def->e->eval(global_env);
+                known.insert(std::make_pair(def->var, val));
+            } else {
+                val = expr->eval(global_env);
+            }
+            if (val->v_type == V_TERMINATE) {
+                if (regions) regionEnd();
+                skipTeardown();
+                return;
+            }
+            val->show(std::cout);
+        }
+        catch (const RuntimeError &RE) {
+            std::cout << "RuntimeError";
+        }
+        if (regions) regionEnd();
+        puts("");
+        if (release_batch != 0) {
+            std::cout.flush();
+            fflush(stdout);
+            drainReleases(0);
+        }
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+/**
+ * @file batch.hpp
+ * @brief Whole-program batch mode
+ *
+ * `code --batch` reads every form on stdin before evaluating any of them,
+ * then evaluates them in order with the same output as the REPL. Knowing
+ * the whole program lets it treat some globals as final: defined exactly
+ * once and never changed. A final global's value is not bound in the
+ * environment at all. Later forms get the value itself in place of every
+ * reference, so lookups of other globals walk a shorter chain.
+ *
+ * Only later forms can see a global in this interpreter: a closure created
+ * before the definition captured an environment without it. Dropping the
+ * binding is therefore unobservable.
+ */
+
+#include "Def.hpp"
+#include "syntax.hpp"
+#include <istream>
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Names of the final globals of a program
+ *
+ * A global is final if it is defined once by a top-level define and is
+ * never assigned, never defined elsewhere and never bound locally. Names
+ * of primitives and special forms are never final, since whether they
+ * are bound changes how forms parse. A program that uses checkpoint or
+ * rollback has no final globals.
+ */
+std::set<std::string> finalGlobals(const std::vector<Syntax> &);
+
+/**
+ * @brief Read a whole program, then evaluate it form by form like the REPL
+ */
+void runBatch(std::istream &, bool regions);
+
+#endif // BATCH_HPP
@@ -12,14 +12,68 @@
 #include "expr.hpp" 
 #include "RE.hpp"
 #include "syntax.hpp"
+#include "limits.hpp"
+#include "jit.hpp"
+#include "stats.hpp"
+#include "pool.hpp"
 #include <cstring>
 #include <vector>
 #include <map>
+#include <set>
 #include <climits>
+#include <cmath>
+#include <algorithm>
+#include <sstream>
 
 extern std::map<std::string, ExprType> primitives;
 extern std::map<std::string, ExprType> reserved_words;
 
+static bool isTruthy(const Value &v) {
+    return !(v->v_type == V_BOOL && dynamic_cast<Boolean*>(v.get())->b == false);
+}
+
+// ============================================================================
+// Primitive watchpoints
+// ============================================================================
+
+PrimitiveWatch unwatched = {"", false};
+unsigned primitive_redefinitions = 0;
+
+static std::map<std::string, PrimitiveWatch> primitive_watches;
+
+PrimitiveWatch *primitiveWatch(const std::string &name) {
+    auto it = primitive_watches.find(name);
+    if (it == primitive_watches.end()) {
+        PrimitiveWatch w = {name, false};
+        it = primitive_watches.insert(std::make_pair(name, w)).first;
+    }
+    return &it->second;
+}
+
+void firePrimitiveWatch(const std::string &name) {
+    if (primitives.count(name) == 0) return;
+    PrimitiveWatch *w = primitiveWatch(name);
+    if (w->fired) return;
+    w->fired = true;
+    ++primitive_redefinitions;
+}
+
+/**
+ * @brief Evaluate a fired node as a call to whatever its name is bound to
+ *
+ * The operator is looked up before any operand is evaluated and operands
+ * go left to right, as in Apply::eval.
+ * @return false if the name is unbound here, and nothing was evaluated
+ */
+static bool applyRedefined(const PrimitiveWatch *w, Assoc &e, const std::vector<Expr> &rands, Value &result) {
+    Value proc = find(w->name, e);
+    if (proc.get() == nullptr) return false;
+    std::vector<Value> args;
+    for (auto &ex : rands) args.push_back(ex->eval(e));
+    result = applyProcedure(proc, args);
+    return true;
+}
+
 Value Fixnum::eval(Assoc &e) { // evaluation of a fixnum
     return IntegerV(n);
 }
@@ -41,22 +95,35 @@ Value False::eval(Assoc &e) { // evaluation of #f
 }
 
 Value MakeVoid::eval(Assoc &e) { // (void)
+    Value redefined(nullptr);
+    if (watch->fired && applyRedefined(watch, e, {}, redefined)) return redefined;
     return VoidV();
 }
 
 Value Exit::eval(Assoc &e) { // (exit)
+    Value redefined(nullptr);
+    if (watch->fired && applyRedefined(watch, e, {}, redefined)) return redefined;
     return TerminateV();
 }
 
 Value Unary::eval(Assoc &e) { // evaluation of single-operator primitive
+    Value redefined(nullptr);
+    if (watch->fired && applyRedefined(watch, e, {rand}, redefined)) return redefined;
     return evalRator(rand->eval(e));
 }
 
 Value Binary::eval(Assoc &e) { // evaluation of two-operators primitive
-    return evalRator(rand1->eval(e), rand2->eval(e));
+    Value redefined(nullptr);
+    if (watch->fired && applyRedefined(watch, e, {rand1, rand2}, redefined)) return redefined;
+    // Operands are evaluated right to left; the JIT's templates rely on this order
+    Value v2 = rand2->eval(e);
+    Value v1 = rand1->eval(e);
+    return evalRator(v1, v2);
 }
 
 Value Variadic::eval(Assoc &e) { // evaluation of multi-operator primitive
+    Value redefined(nullptr);
+    if (watch->fired && applyRedefined(watch, e, rands, redefined)) return redefined;
     std::vector<Value> vals;
     for (auto &ex : rands) {
         vals.push_back(ex->eval(e));
@@ -86,14 +153,42 @@ Value Var::eval(Assoc &e) { // evaluation of variable
                     {E_PROCQ,    {new IsProcedure(new Var("parm")), {"parm"}}},
                     {E_SYMBOLQ,  {new IsSymbol(new Var("parm")), {"parm"}}},
                     {E_STRINGQ,  {new IsString(new Var("parm")), {"parm"}}},
+                    {E_LISTQ,    {new IsList(new Var("parm")), {"parm"}}},
+                    {E_NOT,      {new Not(new Var("parm")), {"parm"}}},
+                    {E_CAR,      {new Car(new Var("parm")), {"parm"}}},
+                    {E_CDR,      {new Cdr(new Var("parm")), {"parm"}}},
+                    {E_CONS,     {new Cons(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+                    {E_SETCAR,   {new SetCar(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+                    {E_SETCDR,   {new SetCdr(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+                    {E_MEMBER,   {new MemberFunc(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+                    {E_ASSOC,    {new AssocFunc(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+                    {E_LT,       {new Less(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+                    {E_LE,       {new LessEq(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+                    {E_EQ,       {new Equal(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+                    {E_GE,       {new GreaterEq(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+                    {E_GT,       {new Greater(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
                     {E_DISPLAY,  {new Display(new Var("parm")), {"parm"}}},
-                    {E_PLUS,     {new PlusVar({}),  {}}},
-                    {E_MINUS,    {new MinusVar({}), {}}},
-                    {E_MUL,      {new MultVar({}),  {}}},
-                    {E_DIV,      {new DivVar({}),   {}}},
+                    {E_PLUS,     {new Plus(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+                    {E_MINUS,    {new Minus(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+                    {E_MUL,      {new Mult(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+                    {E_DIV,      {new Div(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
                     {E_MODULO,   {new Modulo(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
                     {E_EXPT,     {new Expt(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
-                    {E_EQQ,      {new EqualVar({}), {}}},
+                    {E_QUOTIENT, {new Quotient(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+                    {E_REMAINDER, {new Remainder(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+                    {E_GCD,      {new Gcd({new Var("parm1"), new Var("parm2")}), {"parm1","parm2"}}},
+                    {E_LCM,      {new Lcm({new Var("parm1"), new Var("parm2")}), {"parm1","parm2"}}},
+                    {E_EXACT_INT_SQRT, {new ExactIntSqrt(new Var("parm")), {"parm"}}},
+                    {E_EXPT_MOD, {new ExptMod({new Var("parm1"), new Var("parm2"), new Var("parm3")}),
+                                  {"parm1","parm2","parm3"}}},
+                    {E_PRIMEQ,   {new IsPrime(new Var("parm")), {"parm"}}},
+                    {E_EQQ,      {new IsEq(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+                    {E_EQVQ,     {new IsEqv(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+                    {E_EQUALQ,   {new IsEqual(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+                    {E_MAP,      {new Map(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+                    {E_FILTER,   {new Filter(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+                    {E_FOLD,     {new Fold({new Var("parm1"), new Var("parm2"), new Var("parm3")}),
+                                  {"parm1","parm2","parm3"}}},
             };
 
             auto it = primitive_map.find(primitives[x]);
@@ -106,119 +201,214 @@ Value Var::eval(Assoc &e) { // evaluation of variable
                     // For primitives with parameters, leave them unbound here; Apply/Lambda will supply during call
                     // Here we just return the procedure closure with environment tmp
                 }
-                return ProcedureV(it->second.second, it->second.first, e);
+                static std::map<ExprType, CodeRef> primitive_code;
+                CodeRef &code = primitive_code[it->first];
+                if (code.get() == nullptr) code = std::make_shared<ProcedureCode>(it->second.second, it->second.first);
+                return ProcedureV(code, e);
     }
       }
     }
     return matched_value;
 }
 
-Value Plus::evalRator(const Value &a, const Value &b) {
-    if (a->v_type == V_INT && b->v_type == V_INT) {
-        int n1 = dynamic_cast<Integer*>(a.get())->n;
-        int n2 = dynamic_cast<Integer*>(b.get())->n;
-        return IntegerV(n1 + n2);
-    }
-    if (a->v_type == V_RATIONAL && b->v_type == V_INT) {
-        auto r = dynamic_cast<Rational*>(a.get());
-        int n2 = dynamic_cast<Integer*>(b.get())->n;
-        return RationalV(r->numerator + n2 * r->denominator, r->denominator);
-    }
-    if (a->v_type == V_INT && b->v_type == V_RATIONAL) {
-        int n1 = dynamic_cast<Integer*>(a.get())->n;
-        auto r = dynamic_cast<Rational*>(b.get());
-        return RationalV(n1 * r->denominator + r->numerator, r->denominator);
-    }
-    if (a->v_type == V_RATIONAL && b->v_type == V_RATIONAL) {
-        auto r1 = dynamic_cast<Rational*>(a.get());
-        auto r2 = dynamic_cast<Rational*>(b.get());
-        return RationalV(r1->numerator * r2->denominator + r2->numerator * r1->denominator,
-                         r1->denominator * r2->denominator);
-    }
-    throw(RuntimeError("Wrong typename"));
+// ============================================================================
+// Numeric node families
+// ============================================================================
+
+// Pair of operand types, usable as a case label
+constexpr unsigned numericPair(ValueType a, ValueType b) {
+    return (unsigned)a << 4 | (unsigned)b;
 }
 
-Value Minus::evalRator(const Value &a, const Value &b) {
-    if (a->v_type == V_INT && b->v_type == V_INT) {
-        int n1 = dynamic_cast<Integer*>(a.get())->n;
-        int n2 = dynamic_cast<Integer*>(b.get())->n;
-        return IntegerV(n1 - n2);
-    }
-    if (a->v_type == V_RATIONAL && b->v_type == V_INT) {
-        auto r = dynamic_cast<Rational*>(a.get());
-        int n2 = dynamic_cast<Integer*>(b.get())->n;
-        return RationalV(r->numerator - n2 * r->denominator, r->denominator);
-    }
-    if (a->v_type == V_INT && b->v_type == V_RATIONAL) {
-        int n1 = dynamic_cast<Integer*>(a.get())->n;
-        auto r = dynamic_cast<Rational*>(b.get());
-        return RationalV(n1 * r->denominator - r->numerator, r->denominator);
-    }
-    if (a->v_type == V_RATIONAL && b->v_type == V_RATIONAL) {
-        auto r1 = dynamic_cast<Rational*>(a.get());
-        auto r2 = dynamic_cast<Rational*>(b.get());
-        return RationalV(r1->numerator * r2->denominator - r2->numerator * r1->denominator,
-                         r1->denominator * r2->denominator);
-    }
-    throw(RuntimeError("Wrong typename"));
+static int wrapFixnum(int64_t n) {
+    return (int)(uint32_t)n;
 }
 
-Value Mult::evalRator(const Value &a, const Value &b) {
-    if (a->v_type == V_INT && b->v_type == V_INT) {
-        int n1 = dynamic_cast<Integer*>(a.get())->n;
-        int n2 = dynamic_cast<Integer*>(b.get())->n;
-        return IntegerV(n1 * n2);
-    }
-    if (a->v_type == V_RATIONAL && b->v_type == V_INT) {
-        auto r = dynamic_cast<Rational*>(a.get());
-        int n2 = dynamic_cast<Integer*>(b.get())->n;
-        return RationalV(r->numerator * n2, r->denominator);
+// Reduce an exact 64-bit fraction into a rational value
+static Value exactRationalV(int64_t num, int64_t den) {
+    if (den == 0) throw(RuntimeError("Division by zero"));
+    if (den < 0) {
+        num = -num;
+        den = -den;
     }
-    if (a->v_type == V_INT && b->v_type == V_RATIONAL) {
-        int n1 = dynamic_cast<Integer*>(a.get())->n;
-        auto r = dynamic_cast<Rational*>(b.get());
-        return RationalV(n1 * r->numerator, r->denominator);
+    uint64_t a = num < 0 ? 0 - (uint64_t)num : (uint64_t)num, b = (uint64_t)den;
+    while (b != 0) {
+        uint64_t t = a % b;
+        a = b;
+        b = t;
     }
-    if (a->v_type == V_RATIONAL && b->v_type == V_RATIONAL) {
-        auto r1 = dynamic_cast<Rational*>(a.get());
-        auto r2 = dynamic_cast<Rational*>(b.get());
-        return RationalV(r1->numerator * r2->numerator,
-                         r1->denominator * r2->denominator);
+    if (a > 1) {
+        num /= (int64_t)a;
+        den /= (int64_t)a;
     }
-    throw(RuntimeError("Wrong typename"));
+    if (num > INT_MAX || num < INT_MIN || den > INT_MAX) throw(RuntimeError("Integer overflow"));
+    return RationalV((int)num, (int)den);
 }
 
-Value Div::evalRator(const Value &a, const Value &b) {
-    if (b->v_type == V_INT && dynamic_cast<Integer*>(b.get())->n == 0) {
-        throw(RuntimeError("Division by zero"));
-    }
-    if (b->v_type == V_RATIONAL && dynamic_cast<Rational*>(b.get())->numerator == 0) {
-        throw(RuntimeError("Division by zero"));
-    }
-    if (a->v_type == V_INT && b->v_type == V_INT) {
-        int n1 = dynamic_cast<Integer*>(a.get())->n;
-        int n2 = dynamic_cast<Integer*>(b.get())->n;
-        return RationalV(n1, n2);
+template <> Value NumericOp<E_PLUS>::fixnum(int a, int b) {
+    return IntegerV(wrapFixnum((int64_t)a + b));
+}
+
+template <> Value NumericOp<E_PLUS>::rational(int64_t an, int64_t ad, int64_t bn, int64_t bd) {
+    return exactRationalV(an * bd + bn * ad, ad * bd);
+}
+
+template <> Value NumericOp<E_MINUS>::fixnum(int a, int b) {
+    return IntegerV(wrapFixnum((int64_t)a - b));
+}
+
+template <> Value NumericOp<E_MINUS>::rational(int64_t an, int64_t ad, int64_t bn, int64_t bd) {
+    return exactRationalV(an * bd - bn * ad, ad * bd);
+}
+
+template <> Value NumericOp<E_MUL>::fixnum(int a, int b) {
+    return IntegerV(wrapFixnum((int64_t)a * b));
+}
+
+template <> Value NumericOp<E_MUL>::rational(int64_t an, int64_t ad, int64_t bn, int64_t bd) {
+    return exactRationalV(an * bn, ad * bd);
+}
+
+template <> Value NumericOp<E_DIV>::fixnum(int a, int b) {
+    return exactRationalV(a, b);
+}
+
+template <> Value NumericOp<E_DIV>::rational(int64_t an, int64_t ad, int64_t bn, int64_t bd) {
+    return exactRationalV(an * bd, ad * bn);
+}
+
+// Denominators are positive, so cross-multiplying keeps the order
+
+template <> Value NumericOp<E_LT>::fixnum(int a, int b) {
+    return BooleanV(a < b);
+}
+
+template <> Value NumericOp<E_LT>::rational(int64_t an, int64_t ad, int64_t bn, int64_t bd) {
+    return BooleanV(an * bd < bn * ad);
+}
+
+template <> Value NumericOp<E_LE>::fixnum(int a, int b) {
+    return BooleanV(a <= b);
+}
+
+template <> Value NumericOp<E_LE>::rational(int64_t an, int64_t ad, int64_t bn, int64_t bd) {
+    return BooleanV(an * bd <= bn * ad);
+}
+
+template <> Value NumericOp<E_EQ>::fixnum(int a, int b) {
+    return BooleanV(a == b);
+}
+
+template <> Value NumericOp<E_EQ>::rational(int64_t an, int64_t ad, int64_t bn, int64_t bd) {
+    return BooleanV(an * bd == bn * ad);
+}
+
+template <> Value NumericOp<E_GE>::fixnum(int a, int b) {
+    return BooleanV(a >= b);
+}
+
+template <> Value NumericOp<E_GE>::rational(int64_t an, int64_t ad, int64_t bn, int64_t bd) {
+    return BooleanV(an * bd >= bn * ad);
+}
+
+template <> Value NumericOp<E_GT>::fixnum(int a, int b) {
+    return BooleanV(a > b);
+}
+
+template <> Value NumericOp<E_GT>::rational(int64_t an, int64_t ad, int64_t bn, int64_t bd) {
+    return BooleanV(an * bd > bn * ad);
+}
+
+// Unchecked, an operand that is no fixnum is taken to be a rational
+template <typename Op, bool checked = true>
+static inline Value numericApply(const Value &a, const Value &b) {
+    switch (numericPair(a->v_type, b->v_type)) {
+        case numericPair(V_INT, V_INT):
+            return Op::fixnum(static_cast<Integer*>(a.get())->n, static_cast<Integer*>(b.get())->n);
+        case numericPair(V_INT, V_RATIONAL): {
+            Rational *r = static_cast<Rational*>(b.get());
+            return Op::rational(static_cast<Integer*>(a.get())->n, 1, r->numerator, r->denominator);
+        }
+        case numericPair(V_RATIONAL, V_INT): {
+            Rational *r = static_cast<Rational*>(a.get());
+            return Op::rational(r->numerator, r->denominator, static_cast<Integer*>(b.get())->n, 1);
+        }
+        case numericPair(V_RATIONAL, V_RATIONAL): {
+            Rational *r1 = static_cast<Rational*>(a.get());
+            Rational *r2 = static_cast<Rational*>(b.get());
+            return Op::rational(r1->numerator, r1->denominator, r2->numerator, r2->denominator);
+        }
+        default:
+            if (!checked) __builtin_unreachable();
+            throw(RuntimeError("Wrong typename"));
     }
-    if (a->v_type == V_RATIONAL && b->v_type == V_INT) {
-        auto r = dynamic_cast<Rational*>(a.get());
-        int n2 = dynamic_cast<Integer*>(b.get())->n;
-        return RationalV(r->numerator, r->denominator * n2);
+}
+
+template <typename Op>
+Value NumericBinary<Op>::evalRator(const Value &a, const Value &b) {
+    return numericApply<Op>(a, b);
+}
+
+template <typename Op>
+Value UncheckedBinary<Op>::evalRator(const Value &a, const Value &b) {
+    return numericApply<Op, false>(a, b);
+}
+
+template <typename Op>
+Value NumericVariadic<Op>::evalRator(const std::vector<Value> &args) {
+    if (Op::chained) {
+        if (args.empty()) throw(RuntimeError("Wrong number of arguments"));
+        if (args.size() == 1) numericApply<Op>(args[0], args[0]);     // Only the type check
+        bool holds = true;
+        for (size_t i = 0; i + 1 < args.size(); ++i) {
+            // Keep comparing after a failure: every operand must be a number
+            Value r = numericApply<Op>(args[i], args[i + 1]);
+            holds = holds && static_cast<Boolean*>(r.get())->b;
+        }
+        return BooleanV(holds);
     }
-    if (a->v_type == V_INT && b->v_type == V_RATIONAL) {
-        int n1 = dynamic_cast<Integer*>(a.get())->n;
-        auto r = dynamic_cast<Rational*>(b.get());
-        return RationalV(n1 * r->denominator, r->numerator);
+    if (args.empty()) {
+        if (!Op::nullary) throw(RuntimeError("Wrong number of arguments"));
+        return IntegerV(Op::unit);
     }
-    if (a->v_type == V_RATIONAL && b->v_type == V_RATIONAL) {
-        auto r1 = dynamic_cast<Rational*>(a.get());
-        auto r2 = dynamic_cast<Rational*>(b.get());
-        return RationalV(r1->numerator * r2->denominator,
-                         r1->denominator * r2->numerator);
+    Value acc = args[0];
+    size_t i = 1;
+    if (args.size() == 1) {
+        acc = IntegerV(Op::unit);
+        i = 0;
     }
-    throw(RuntimeError("Wrong typename"));
+    for (; i < args.size(); ++i) acc = numericApply<Op>(acc, args[i]);
+    return acc;
 }
 
+template struct NumericBinary<NumericOp<E_PLUS> >;
+template struct NumericBinary<NumericOp<E_MINUS> >;
+template struct NumericBinary<NumericOp<E_MUL> >;
+template struct NumericBinary<NumericOp<E_DIV> >;
+template struct NumericBinary<NumericOp<E_LT> >;
+template struct NumericBinary<NumericOp<E_LE> >;
+template struct NumericBinary<NumericOp<E_EQ> >;
+template struct NumericBinary<NumericOp<E_GE> >;
+template struct NumericBinary<NumericOp<E_GT> >;
+template struct NumericVariadic<NumericOp<E_PLUS> >;
+template struct NumericVariadic<NumericOp<E_MINUS> >;
+template struct NumericVariadic<NumericOp<E_MUL> >;
+template struct NumericVariadic<NumericOp<E_DIV> >;
+template struct NumericVariadic<NumericOp<E_LT> >;
+template struct NumericVariadic<NumericOp<E_LE> >;
+template struct NumericVariadic<NumericOp<E_EQ> >;
+template struct NumericVariadic<NumericOp<E_GE> >;
+template struct NumericVariadic<NumericOp<E_GT> >;
+template struct UncheckedBinary<NumericOp<E_PLUS> >;
+template struct UncheckedBinary<NumericOp<E_MINUS> >;
+template struct UncheckedBinary<NumericOp<E_MUL> >;
+template struct UncheckedBinary<NumericOp<E_DIV> >;
+template struct UncheckedBinary<NumericOp<E_LT> >;
+template struct UncheckedBinary<NumericOp<E_LE> >;
+template struct UncheckedBinary<NumericOp<E_EQ> >;
+template struct UncheckedBinary<NumericOp<E_GE> >;
+template struct UncheckedBinary<NumericOp<E_GT> >;
+
 Value Modulo::evalRator(const Value &rand1, const Value &rand2) { // modulo
     if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
         int dividend = dynamic_cast<Integer*>(rand1.get())->n;
@@ -231,22 +421,6 @@ Value Modulo::evalRator(const Value &rand1, const Value &rand2) { // modulo
     throw(RuntimeError("modulo is only defined for integers"));
 }
 
-Value PlusVar::evalRator(const std::vector<Value> &args) { // + with multiple args
-    //TODO: To complete the addition logic
-}
-
-Value MinusVar::evalRator(const std::vector<Value> &args) { // - with multiple args
-    //TODO: To complete the substraction logic
-}
-
-Value MultVar::evalRator(const std::vector<Value> &args) { // * with multiple args
-    //TODO: To complete the multiplication logic
-}
-
-Value DivVar::evalRator(const std::vector<Value> &args) { // / with multiple args
-    //TODO: To complete the divisor logic
-}
-
 Value Expt::evalRator(const Value &rand1, const Value &rand2) { // expt
     if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
         int base = dynamic_cast<Integer*>(rand1.get())->n;
@@ -284,75 +458,132 @@ Value Expt::evalRator(const Value &rand1, const Value &rand2) { // expt
     throw(RuntimeError("Wrong typename"));
 }
 
-//A FUNCTION TO SIMPLIFY THE COMPARISON WITH INTEGER AND RATIONAL NUMBER
-int compareNumericValues(const Value &v1, const Value &v2) {
-    if (v1->v_type == V_INT && v2->v_type == V_INT) {
-        int n1 = dynamic_cast<Integer*>(v1.get())->n;
-        int n2 = dynamic_cast<Integer*>(v2.get())->n;
-        return (n1 < n2) ? -1 : (n1 > n2) ? 1 : 0;
-    }
-    else if (v1->v_type == V_RATIONAL && v2->v_type == V_INT) {
-        Rational* r1 = dynamic_cast<Rational*>(v1.get());
-        int n2 = dynamic_cast<Integer*>(v2.get())->n;
-        int left = r1->numerator;
-        int right = n2 * r1->denominator;
-        return (left < right) ? -1 : (left > right) ? 1 : 0;
-    }
-    else if (v1->v_type == V_INT && v2->v_type == V_RATIONAL) {
-        int n1 = dynamic_cast<Integer*>(v1.get())->n;
-        Rational* r2 = dynamic_cast<Rational*>(v2.get());
-        int left = n1 * r2->denominator;
-        int right = r2->numerator;
-        return (left < right) ? -1 : (left > right) ? 1 : 0;
-    }
-    else if (v1->v_type == V_RATIONAL && v2->v_type == V_RATIONAL) {
-        Rational* r1 = dynamic_cast<Rational*>(v1.get());
-        Rational* r2 = dynamic_cast<Rational*>(v2.get());
-        int left = r1->numerator * r2->denominator;
-        int right = r2->numerator * r1->denominator;
-        return (left < right) ? -1 : (left > right) ? 1 : 0;
-    }
-    throw RuntimeError("Wrong typename in numeric comparison");
+// ============================================================================
+// Number theory
+// ============================================================================
+
+static int integerOperand(const Value &v) {
+    if (v->v_type != V_INT) throw(RuntimeError("Wrong typename"));
+    return static_cast<Integer*>(v.get())->n;
 }
 
-Value Less::evalRator(const Value &a, const Value &b) {
-    return BooleanV(compareNumericValues(a, b) < 0);
+static Value checkedIntegerV(int64_t n) {
+    if (n > INT_MAX || n < INT_MIN) throw(RuntimeError("Integer overflow"));
+    return IntegerV((int)n);
 }
 
-Value LessEq::evalRator(const Value &a, const Value &b) {
-    return BooleanV(compareNumericValues(a, b) <= 0);
+static uint32_t magnitude(int n) {
+    return n < 0 ? 0u - (uint32_t)n : (uint32_t)n;
 }
 
-Value Equal::evalRator(const Value &a, const Value &b) {
-    return BooleanV(compareNumericValues(a, b) == 0);
+// Stein's algorithm: strip common factors of two, then subtract odd from odd
+static uint32_t binaryGcd(uint32_t a, uint32_t b) {
+    if (a == 0) return b;
+    if (b == 0) return a;
+    int shift = __builtin_ctz(a | b);
+    a >>= __builtin_ctz(a);
+    do {
+        b >>= __builtin_ctz(b);
+        if (a > b) std::swap(a, b);
+        b -= a;
+    } while (b != 0);
+    return a << shift;
 }
 
-Value GreaterEq::evalRator(const Value &a, const Value &b) {
-    return BooleanV(compareNumericValues(a, b) >= 0);
+// Square-and-multiply; residues are below 2^32, so products fit in 64 bits
+static uint32_t powMod(uint32_t base, uint32_t exponent, uint32_t m) {
+    uint64_t result = 1 % m;
+    uint64_t b = base % m;
+    while (exponent != 0) {
+        if (exponent & 1) result = result * b % m;
+        b = b * b % m;
+        exponent >>= 1;
+    }
+    return (uint32_t)result;
 }
 
-Value Greater::evalRator(const Value &a, const Value &b) {
-    return BooleanV(compareNumericValues(a, b) > 0);
+// Deterministic Miller-Rabin: the bases 2, 7 and 61 decide every n < 2^32.
+// Trial division runs through 61, so n exceeds every base in the test.
+static bool isPrime(uint32_t n) {
+    static const uint32_t small[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53, 59, 61};
+    if (n < 2) return false;
+    for (uint32_t p : small) {
+        if (n % p == 0) return n == p;
+    }
+    uint32_t d = n - 1;
+    int s = __builtin_ctz(d);
+    d >>= s;
+    static const uint32_t bases[] = {2, 7, 61};
+    for (uint32_t a : bases) {
+        uint64_t x = powMod(a, d, n);
+        if (x == 1 || x == n - 1) continue;
+        bool witness = true;
+        for (int r = 1; r < s && witness; ++r) {
+            x = x * x % n;
+            if (x == n - 1) witness = false;
+        }
+        if (witness) return false;
+    }
+    return true;
 }
 
-Value LessVar::evalRator(const std::vector<Value> &args) { // < with multiple args
-    //TODO: To complete the less logic
+Value Quotient::evalRator(const Value &rand1, const Value &rand2) { // quotient
+    int64_t dividend = integerOperand(rand1);
+    int64_t divisor = integerOperand(rand2);
+    if (divisor == 0) throw(RuntimeError("Division by zero"));
+    return checkedIntegerV(dividend / divisor);
 }
 
-Value LessEqVar::evalRator(const std::vector<Value> &args) { // <= with multiple args
-    //TODO: To complete the lesseq logic
+Value Remainder::evalRator(const Value &rand1, const Value &rand2) { // remainder
+    int64_t dividend = integerOperand(rand1);
+    int64_t divisor = integerOperand(rand2);
+    if (divisor == 0) throw(RuntimeError("Division by zero"));
+    return IntegerV((int)(dividend % divisor));
 }
 
-Value EqualVar::evalRator(const std::vector<Value> &args) { // = with multiple args
-    //TODO: To complete the equal logic
+Value Gcd::evalRator(const std::vector<Value> &args) { // gcd
+    uint32_t g = 0;
+    for (auto &v : args) g = binaryGcd(g, magnitude(integerOperand(v)));
+    return checkedIntegerV(g);
 }
 
-Value GreaterEqVar::evalRator(const std::vector<Value> &args) { // >= with multiple args
-    //TODO: To complete the greatereq logic
+Value Lcm::evalRator(const std::vector<Value> &args) { // lcm
+    uint64_t l = 1;
+    for (auto &v : args) {
+        uint32_t m = magnitude(integerOperand(v));
+        if (m == 0 || l == 0) {
+            l = 0;
+            continue;
+        }
+        l = l / binaryGcd((uint32_t)l, m) * m;
+        if (l > INT_MAX) throw(RuntimeError("Integer overflow"));
+    }
+    return IntegerV((int)l);
+}
+
+Value ExactIntSqrt::evalRator(const Value &rand) { // exact-integer-sqrt
+    int k = integerOperand(rand);
+    if (k < 0) throw(RuntimeError("exact-integer-sqrt of a negative number"));
+    int64_t s = (int64_t)std::sqrt((double)k);
+    while (s * s > k) --s;
+    while ((s + 1) * (s + 1) <= k) ++s;
+    return PairV(IntegerV((int)s), PairV(IntegerV((int)(k - s * s)), NullV()));
 }
 
-Value GreaterVar::evalRator(const std::vector<Value> &args) { // > with multiple args
-    //TODO: To complete the greater logic
+Value ExptMod::evalRator(const std::vector<Value> &args) { // expt-mod
+    int64_t base = integerOperand(args[0]);
+    int exponent = integerOperand(args[1]);
+    int64_t m = integerOperand(args[2]);
+    if (m == 0) throw(RuntimeError("Division by zero"));
+    if (m < 0) throw(RuntimeError("expt-mod needs a positive modulus"));
+    if (exponent < 0) throw(RuntimeError("Negative exponent not supported for integers"));
+    base = (base % m + m) % m;
+    return IntegerV((int)powMod((uint32_t)base, (uint32_t)exponent, (uint32_t)m));
+}
+
+Value IsPrime::evalRator(const Value &rand) { // prime?
+    int n = integerOperand(rand);
+    return BooleanV(n > 0 && isPrime((uint32_t)n));
 }
 
 Value Cons::evalRator(const Value &a, const Value &d) {
@@ -396,20 +627,109 @@ Value Cdr::evalRator(const Value &v) {
     return p->cdr;
 }
 
+Value UncheckedCar::evalRator(const Value &v) {
+    return static_cast<Pair*>(v.get())->car;
+}
+
+Value UncheckedCdr::evalRator(const Value &v) {
+    return static_cast<Pair*>(v.get())->cdr;
+}
+
 Value SetCar::evalRator(const Value &pairv, const Value &newcar) {
     if (pairv->v_type != V_PAIR) throw RuntimeError("set-car! on non-pair");
     Pair* p = dynamic_cast<Pair*>(pairv.get());
-    p->car = newcar;
+    journalWrite(pairv.ptr, p->car, newcar);
     return VoidV();
 }
 
 Value SetCdr::evalRator(const Value &pairv, const Value &newcdr) {
     if (pairv->v_type != V_PAIR) throw RuntimeError("set-cdr! on non-pair");
     Pair* p = dynamic_cast<Pair*>(pairv.get());
-    p->cdr = newcdr;
+    journalWrite(pairv.ptr, p->cdr, newcdr);
     return VoidV();
 }
 
+// The list searches step a second pointer at half speed: meeting it means
+// the list is cyclic, and the search stops instead of looping forever.
+
+Value MemberFunc::evalRator(const Value &x, const Value &lst) { // member
+    Value cur = lst, slow = lst;
+    for (bool step = false; cur->v_type == V_PAIR; step = !step) {
+        Pair *p = static_cast<Pair*>(cur.get());
+        if (isEqual(x, p->car)) return cur;
+        cur = p->cdr;
+        if (step) slow = static_cast<Pair*>(slow.get())->cdr;
+        if (cur.get() == slow.get()) throw RuntimeError("member: circular list");
+    }
+    if (cur->v_type != V_NULL) throw RuntimeError("member: not a list");
+    return BooleanV(false);
+}
+
+Value AssocFunc::evalRator(const Value &key, const Value &alist) { // assoc
+    Value cur = alist, slow = alist;
+    for (bool step = false; cur->v_type == V_PAIR; step = !step) {
+        Pair *p = static_cast<Pair*>(cur.get());
+        if (p->car->v_type != V_PAIR) throw RuntimeError("assoc: element is not a pair");
+        if (isEqual(key, static_cast<Pair*>(p->car.get())->car)) return p->car;
+        cur = p->cdr;
+        if (step) slow = static_cast<Pair*>(slow.get())->cdr;
+        if (cur.get() == slow.get()) throw RuntimeError("assoc: circular list");
+    }
+    if (cur->v_type != V_NULL) throw RuntimeError("assoc: not a list");
+    return BooleanV(false);
+}
+
+// ============================================================================
+// List combinators
+// ============================================================================
+
+/**
+ * @brief Builds a fresh list front to back through its last pair
+ */
+struct ListBuilder {
+    Value head;
+    Pair *last;
+    ListBuilder() : head(NullV()), last(nullptr) {}
+    void push(const Value &v) {
+        Value cell = PairV(v, NullV());
+        if (last == nullptr) head = cell;
+        else last->cdr = cell;      // Not yet reachable by the program: no journaling
+        last = static_cast<Pair*>(cell.get());
+    }
+};
+
+Value Map::evalRator(const Value &proc, const Value &lst) {
+    if (proc->v_type != V_PROC) throw RuntimeError("map: not a procedure");
+    ListBuilder out;
+    Value cur = lst;
+    for (; cur->v_type == V_PAIR; cur = static_cast<Pair*>(cur.get())->cdr)
+        out.push(applyProcedure(proc, {static_cast<Pair*>(cur.get())->car}));
+    if (cur->v_type != V_NULL) throw RuntimeError("map: not a list");
+    return out.head;
+}
+
+Value Filter::evalRator(const Value &pred, const Value &lst) {
+    if (pred->v_type != V_PROC) throw RuntimeError("filter: not a procedure");
+    ListBuilder out;
+    Value cur = lst;
+    for (; cur->v_type == V_PAIR; cur = static_cast<Pair*>(cur.get())->cdr) {
+        const Value &x = static_cast<Pair*>(cur.get())->car;
+        if (isTruthy(applyProcedure(pred, {x}))) out.push(x);
+    }
+    if (cur->v_type != V_NULL) throw RuntimeError("filter: not a list");
+    return out.head;
+}
+
+Value Fold::evalRator(const std::vector<Value> &args) {
+    if (args[0]->v_type != V_PROC) throw RuntimeError("fold: not a procedure");
+    Value acc = args[1];
+    Value cur = args[2];
+    for (; cur->v_type == V_PAIR; cur = static_cast<Pair*>(cur.get())->cdr)
+        acc = applyProcedure(args[0], {static_cast<Pair*>(cur.get())->car, acc});
+    if (cur->v_type != V_NULL) throw RuntimeError("fold: not a list");
+    return acc;
+}
+
 Value IsEq::evalRator(const Value &rand1, const Value &rand2) { // eq?
     // Check if type is Integer
     if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
@@ -432,6 +752,14 @@ Value IsEq::evalRator(const Value &rand1, const Value &rand2) { // eq?
     }
 }
 
+Value IsEqv::evalRator(const Value &rand1, const Value &rand2) { // eqv?
+    return BooleanV(isEqv(rand1, rand2));
+}
+
+Value IsEqual::evalRator(const Value &rand1, const Value &rand2) { // equal?
+    return BooleanV(isEqual(rand1, rand2));
+}
+
 Value IsBoolean::evalRator(const Value &rand) { // boolean?
     return BooleanV(rand->v_type == V_BOOL);
 }
@@ -487,6 +815,8 @@ Value Quote::eval(Assoc& e) {
 }
 
 Value AndVar::eval(Assoc &e) {
+    Value redefined(nullptr);
+    if (watch->fired && applyRedefined(watch, e, rands, redefined)) return redefined;
     Value last = BooleanV(true);
     for (auto &ex : rands) {
         last = ex->eval(e);
@@ -496,6 +826,8 @@ Value AndVar::eval(Assoc &e) {
 }
 
 Value OrVar::eval(Assoc &e) {
+    Value redefined(nullptr);
+    if (watch->fired && applyRedefined(watch, e, rands, redefined)) return redefined;
     Value last = BooleanV(false);
     for (auto &ex : rands) {
         last = ex->eval(e);
@@ -510,8 +842,13 @@ Value Not::evalRator(const Value &v) {
 }
 
 Value If::eval(Assoc &e) {
-    Value c = cond->eval(e);
-    bool truth = !(c->v_type == V_BOOL && dynamic_cast<Boolean*>(c.get())->b == false);
+    bool truth;
+    if (cond->e_type == E_UNBOXED_TEST) {
+        truth = static_cast<UnboxedFixnum*>(cond.get())->test(e);
+    } else {
+        Value c = cond->eval(e);
+        truth = !(c->v_type == V_BOOL && dynamic_cast<Boolean*>(c.get())->b == false);
+    }
     if (truth) return conseq->eval(e);
     return alter->eval(e);
 }
@@ -520,34 +857,167 @@ Value Cond::eval(Assoc &env) {
     //TODO: To complete the cond logic
 }
 
+int Case::selectFixnum(int n) {
+    if (!jump.empty()) {
+        long off = (long)n - jump_base;
+        if (off >= 0 && off < (long)jump.size()) return jump[off];
+        return -1;
+    }
+    auto it = fixnums.find(n);
+    return it == fixnums.end() ? -1 : it->second;
+}
+
+int Case::select(const Value &v) {
+    switch (v->v_type) {
+        case V_INT:
+            return selectFixnum(static_cast<Integer*>(v.get())->n);
+        case V_RATIONAL: {
+            Rational *r = static_cast<Rational*>(v.get());
+            if (r->denominator == 1) return selectFixnum(r->numerator);
+            auto it = rationals.find(std::make_pair(r->numerator, r->denominator));
+            return it == rationals.end() ? -1 : it->second;
+        }
+        case V_SYM: {
+            auto it = symbols.find(static_cast<Symbol*>(v.get())->s);
+            return it == symbols.end() ? -1 : it->second;
+        }
+        case V_BOOL:
+            return booleans[static_cast<Boolean*>(v.get())->b ? 1 : 0];
+        case V_NULL:
+            return null_clause;
+        default:
+            return -1;
+    }
+}
+
+Value Case::eval(Assoc &env) {
+    Value k = key->eval(env);
+    int clause = select(k);
+    if (clause < 0) clause = else_clause;
+    if (clause < 0) return VoidV();
+    if (!receivers[clause]) return bodies[clause]->eval(env);
+    Value receiver = bodies[clause]->eval(env);
+    if (receiver->v_type != V_PROC) throw RuntimeError("case: => receiver is not a procedure");
+    return applyProcedure(receiver, std::vector<Value>(1, k));
+}
+
+// Closed lambdas currently holding a shared procedure
+static std::set<Lambda*> lifted_lambdas;
+
+Lambda::~Lambda() {
+    lifted_lambdas.erase(this);
+}
+
+void dropLiftedProcedures() {
+    // Detach every procedure first: releasing one may destroy other lambdas
+    std::vector<std::shared_ptr<ValueBase>> held;
+    for (Lambda *l : lifted_lambdas) held.push_back(std::move(l->lifted));
+    lifted_lambdas.clear();
+}
+
 Value Lambda::eval(Assoc &env) {
-    return ProcedureV(x, e, env);
+    if (code.get() == nullptr) code = std::make_shared<ProcedureCode>(x, e);
+    if (!closed) return ProcedureV(code, env);
+    // Skip the local bindings; the rest of the environment is global
+    AssocList *globals = env.get();
+    for (size_t i = 0; i < lift_hops; ++i) globals = globals->next.get();
+    if (lifted.get() != nullptr && static_cast<Procedure*>(lifted.get())->env.get() == globals)
+        return Value(lifted);
+    Assoc tail = env;
+    for (size_t i = 0; i < lift_hops; ++i) tail = tail->next;
+    RegionPause pause;      // Held by the lambda, not the form
+    lifted = ProcedureV(code, tail).ptr;
+    lifted_lambdas.insert(this);
+    return Value(lifted);
 }
 
 Value Apply::eval(Assoc &e) {
-    Value proc = rator->eval(e);
-    if (proc->v_type != V_PROC) {throw RuntimeError("Attempt to apply a non-procedure");}
-    Procedure* clos_ptr = dynamic_cast<Procedure*>(proc.get());
+    if (jit_replay != nullptr) {
+        Value replayed(nullptr);
+        if (jitReplayed(this, e, replayed)) return replayed;
+    }
+    if (known != nullptr) {
+        // Known call: the closure is at a fixed depth and its arity already matched
+        AssocList *binding = e.get();
+        for (size_t i = 0; i < known_hops; ++i) binding = binding->next.get();
+        Procedure *callee = static_cast<Procedure*>(binding->v.get());
+        if (callee != nullptr) {
+            std::vector<Value> args;
+            for (auto &ex : rand) args.push_back(ex->eval(e));
+            return applyClosure(callee, args);
+        }
+    }
+    Value proc = global.get() != nullptr && global_epoch == env_epoch ? global->v : rator->eval(e);
+    if (!unchecked && proc->v_type != V_PROC) {throw RuntimeError("Attempt to apply a non-procedure");}
 
     // Evaluate arguments
     std::vector<Value> args;
     for (auto &ex : rand) args.push_back(ex->eval(e));
+    if (unchecked) return applyClosure(static_cast<Procedure*>(proc.get()), args);
+
+    // Inline cache: a code seen here before already passed the arity check
+    Procedure *callee = static_cast<Procedure*>(proc.get());
+    for (auto &code : cache) {
+        if (code == callee->code) {
+            ++cache_hits;
+            ++interp_stats.call_hits;
+            return applyClosure(callee, args);
+        }
+    }
+    ++cache_misses;
+    ++interp_stats.call_misses;
+    if (callee->code->arity == rand.size()) {
+        if (cache.size() < CALL_CACHE_WAYS) {
+            cache.push_back(callee->code);
+        } else {
+            ++interp_stats.megamorphic;
+            Var *name = dynamic_cast<Var*>(rator.get());
+            ++interp_stats.megamorphic_sites[name != nullptr ? name->x : "(computed operator)"];
+        }
+    }
+    return applyProcedure(proc, args);
+}
+
+Value applyProcedure(const Value &proc, const std::vector<Value> &args) {
+    if (proc->v_type != V_PROC) throw RuntimeError("Attempt to apply a non-procedure");
+    Procedure* clos_ptr = dynamic_cast<Procedure*>(proc.get());
 
     // Check arity
-    if (args.size() != clos_ptr->parameters.size()) throw RuntimeError("Wrong number of arguments");
+    if (args.size() != clos_ptr->code->arity) throw RuntimeError("Wrong number of arguments");
+
+    return applyClosure(clos_ptr, args);
+}
+
+Value applyClosure(Procedure *clos_ptr, const std::vector<Value> &args) {
+    consumeFuel();
+    Value jitted(nullptr);
+    if (jitCall(clos_ptr, args, jitted)) return jitted;
 
     // Build call environment: extend closure env with parameter bindings
+    const ProcedureCode &code = *clos_ptr->code;
     Assoc call_env = clos_ptr->env;
-    for (size_t i = 0; i < clos_ptr->parameters.size(); ++i) {
-        call_env = extend(clos_ptr->parameters[i], args[i], call_env);
+    for (size_t i = 0; i < code.arity; ++i) {
+        call_env = extend(code.parameters[i], args[i], call_env);
     }
 
-    return clos_ptr->e->eval(call_env);
+    return code.body->eval(call_env);
+}
+
+Value NativeCode::eval(Assoc &env) {
+    return fn(env);
+}
+
+Value LazyBody::eval(Assoc &env) {
+    if (body.get() == nullptr) force(env);
+    return body->eval(env);
 }
 
 Value Define::eval(Assoc &env) {
+    // The value and its binding outlive the form: keep them out of the region
+    RegionPause pause;
     // Evaluate expression and bind globally
     Value v = e->eval(env);
+    firePrimitiveWatch(var);
     // Allow redefine
     if (find(var, env).get() != nullptr) {
         modify(var, v, env);
@@ -585,6 +1055,7 @@ Value Letrec::eval(Assoc &env) {
 }
 
 Value Set::eval(Assoc &env) {
+    RegionPause pause;
     Value v = e->eval(env);
     modify(var, v, env);
     return v;
@@ -600,3 +1071,251 @@ Value Display::evalRator(const Value &rand) { // display function
     
     return VoidV();
 }
+
+Value MakeCheckpoint::eval(Assoc &env) { // (checkpoint)
+    Value redefined(nullptr);
+    if (watch->fired && applyRedefined(watch, env, {}, redefined)) return redefined;
+    return IntegerV((int)checkpointCreate(env));
+}
+
+Value Rollback::eval(Assoc &env) { // (rollback id)
+    Value redefined(nullptr);
+    if (watch->fired && applyRedefined(watch, env, {id}, redefined)) return redefined;
+    Value v = id->eval(env);
+    if (v->v_type != V_INT) throw RuntimeError("rollback expects a checkpoint id");
+    int n = dynamic_cast<Integer*>(v.get())->n;
+    if (n < 0 || (size_t)n >= checkpointCount()) throw RuntimeError("Unknown checkpoint");
+    env = checkpointRestore((size_t)n);
+    return VoidV();
+}
+
+// Exception handlers installed by with-exception-handler, innermost last.
+// A null entry marks a guard: raises below it unwind to that guard.
+static std::vector<Value> handler_stack;
+
+/**
+ * @brief Pushes a handler (or a guard marker) for the lifetime of the object
+ */
+struct HandlerFrame {
+    HandlerFrame(const Value &h) { handler_stack.push_back(h); }
+    ~HandlerFrame() { handler_stack.pop_back(); }
+};
+
+/**
+ * @brief Pops the current handler so it runs in the outer handler context
+ */
+struct HandlerSuspend {
+    Value saved;
+    HandlerSuspend() : saved(handler_stack.back()) { handler_stack.pop_back(); }
+    ~HandlerSuspend() { handler_stack.push_back(saved); }
+};
+
+/**
+ * @brief Deliver obj to the current handler
+ *
+ * A handler installed by with-exception-handler is called in place, so a
+ * raise-continuable handled this way involves no C++ exception at all. Only
+ * when the nearest handler is a guard (or there is none) does the raise
+ * unwind, as a RaisedError.
+ */
+static Value raiseValue(const Value &obj, bool continuable) {
+    if (handler_stack.empty() || handler_stack.back().get() == nullptr)
+        throw RaisedError(obj.ptr);
+    Value result(nullptr);
+    {
+        HandlerSuspend outer;
+        result = applyProcedure(outer.saved, std::vector<Value>(1, obj));
+    }
+    if (continuable) return result;
+    throw RaisedError(ErrorObjectV("handler returned from non-continuable raise", PairV(obj, NullV())).ptr);
+}
+
+/**
+ * @brief The Scheme object describing an error caught from C++
+ */
+static Value conditionOf(const RuntimeError &err) {
+    const RaisedError *raised = dynamic_cast<const RaisedError*>(&err);
+    if (raised != nullptr) {
+        Value v(nullptr);
+        v.ptr = raised->payload;
+        return v;
+    }
+    return ErrorObjectV(err.message(), NullV());
+}
+
+Value Raise::evalRator(const Value &obj) { // raise
+    return raiseValue(obj, false);
+}
+
+Value RaiseContinuable::evalRator(const Value &obj) { // raise-continuable
+    return raiseValue(obj, true);
+}
+
+Value ErrorFunc::evalRator(const std::vector<Value> &args) { // error
+    std::string msg;
+    if (args[0]->v_type == V_STRING) {
+        msg = dynamic_cast<String*>(args[0].get())->s;
+    } else {
+        std::ostringstream os;
+        args[0]->show(os);
+        msg = os.str();
+    }
+    Value irritants = NullV();
+    for (size_t i = args.size() - 1; i >= 1; --i) {
+        irritants = PairV(args[i], irritants);
+    }
+    return raiseValue(ErrorObjectV(msg, irritants), false);
+}
+
+Value WithHandler::evalRator(const Value &handler, const Value &thunk) { // with-exception-handler
+    if (handler->v_type != V_PROC || thunk->v_type != V_PROC)
+        throw RuntimeError("with-exception-handler expects procedures");
+    Value condition(nullptr);
+    try {
+        HandlerFrame frame(handler);
+        return applyProcedure(thunk, std::vector<Value>());
+    } catch (const RaisedError &) {
+        // Already delivered to this handler or meant for an outer one
+        throw;
+    } catch (const RuntimeError &err) {
+        // Primitive errors are thrown, not raised, so the handler has not
+        // seen them yet. They unwind to here, where the frame is gone and
+        // the outer handlers are active, as raiseValue would arrange.
+        condition = conditionOf(err);
+    }
+    applyProcedure(handler, std::vector<Value>(1, condition));
+    return raiseValue(ErrorObjectV("handler returned from non-continuable raise",
+                                   PairV(condition, NullV())), false);
+}
+
+Value IsErrorObject::evalRator(const Value &v) { // error-object?
+    return BooleanV(v->v_type == V_ERROR);
+}
+
+Value ErrorObjectMessage::evalRator(const Value &v) { // error-object-message
+    if (v->v_type != V_ERROR) throw RuntimeError("error-object-message on non-error");
+    return StringV(dynamic_cast<ErrorObject*>(v.get())->message);
+}
+
+Value ErrorObjectIrritants::evalRator(const Value &v) { // error-object-irritants
+    if (v->v_type != V_ERROR) throw RuntimeError("error-object-irritants on non-error");
+    return dynamic_cast<ErrorObject*>(v.get())->irritants;
+}
+
+Value Guard::eval(Assoc &e) {
+    Value condition(nullptr);
+    try {
+        HandlerFrame frame(Value(nullptr));
+        return body->eval(e);
+    } catch (const RuntimeError &err) {
+        condition = conditionOf(err);
+    }
+    Assoc local = extend(var, condition, e);
+    for (size_t i = 0; i < clauses.size(); ++i) {
+        Value test = clauses[i].first->eval(local);
+        if (!isTruthy(test)) continue;
+        if (clauses[i].second.get() == nullptr) return test;
+        if (!receivers[i]) return clauses[i].second->eval(local);
+        Value receiver = clauses[i].second->eval(local);
+        if (receiver->v_type != V_PROC) throw RuntimeError("guard: => receiver is not a procedure");
+        return applyProcedure(receiver, std::vector<Value>(1, test));
+    }
+    // No clause matched: re-raise in the guard's own context
+    return raiseValue(condition, true);
+}
+
+bool UnboxedFixnum::compute(size_t i, Assoc &env, long long &out) {
+    const FixnumOp &op = ops[i];
+    switch (op.op) {
+        case E_FIXNUM:
+            out = op.n;
+            return true;
+        case E_VAR: {
+            AssocList *binding = env.get();
+            for (size_t h = 0; h < op.hops; ++h) binding = binding->next.get();
+            out = static_cast<Integer*>(binding->v.get())->n;
+            return true;
+        }
+        default: {
+            long long a, b;
+            if (!compute(op.lhs, env, a) || !compute(op.rhs, env, b)) return false;
+            out = op.op == E_PLUS ? a + b : op.op == E_MINUS ? a - b : a * b;
+            return out >= INT_MIN && out <= INT_MAX;
+        }
+    }
+}
+
+bool UnboxedFixnum::test(Assoc &env) {
+    long long a, b;
+    if (watches.fired() || !compute(rhs, env, b) || !compute(lhs, env, a)) return isTruthy(generic->eval(env));
+    switch (cmp) {
+        case E_LT: return a < b;
+        case E_LE: return a <= b;
+        case E_GE: return a >= b;
+        case E_GT: return a > b;
+        default: return a == b;
+    }
+}
+
+Value UnboxedFixnum::eval(Assoc &env) {
+    if (e_type == E_UNBOXED_TEST) return BooleanV(test(env));
+    long long n;
+    if (watches.fired() || !compute(root, env, n)) return generic->eval(env);
+    return IntegerV((int)n);
+}
+
+Value ListPipeline::eval(Assoc &env) {
+    if (watches.fired()) return generic->eval(env);
+    // Same order as the nested calls: fold's operands, the source, then inner stages first
+    Value proc(nullptr), acc(nullptr);
+    if (kons.get() != nullptr) {
+        proc = kons->eval(env);
+        acc = knil->eval(env);
+        if (proc->v_type != V_PROC) throw RuntimeError("fold: not a procedure");
+    }
+    Value cur = source->eval(env);
+    std::vector<Value> procs;
+    for (auto &stage : stages) {
+        procs.push_back(stage.second->eval(env));
+        if (procs.back()->v_type != V_PROC) throw RuntimeError("map or filter: not a procedure");
+    }
+    ListBuilder out;
+    for (; cur->v_type == V_PAIR; cur = static_cast<Pair*>(cur.get())->cdr) {
+        Value x = static_cast<Pair*>(cur.get())->car;
+        bool kept = true;
+        for (size_t i = 0; kept && i < stages.size(); ++i) {
+            Value r = applyProcedure(procs[i], {x});
+            if (stages[i].first == E_MAP) x = r;
+            else kept = isTruthy(r);
+        }
+        if (!kept) continue;
+        if (kons.get() != nullptr) acc = applyProcedure(proc, {x, acc});
+        else out.push(x);
+    }
+    if (cur->v_type != V_NULL) throw RuntimeError("map, filter or fold: not a list");
+    return kons.get() != nullptr ? acc : out.head;
+}
+
+Value Constant::eval(Assoc &env) {
+    return Value(value);
+}
+
+Value MakeBox::eval(Assoc &env) {
+    return BoxV(e->eval(env));
+}
+
+Value BoxRef::eval(Assoc &env) {
+    Value box = find(x, env);
+    // Unassigned: a letrec initializer referring to its own variable
+    if (box.get() == nullptr) throw RuntimeError("Unbound variable " + x);
+    return static_cast<Box*>(box.get())->content;
+}
+
+Value BoxSet::eval(Assoc &env) {
+    RegionPause pause;
+    Value v = e->eval(env);
+    Value box = find(var, env);
+    if (box.get() == nullptr) throw RuntimeError("Unbound variable " + var);
+    journalWrite(box.ptr, static_cast<Box*>(box.get())->content, v);
+    return v;
+}
@@ -1,5 +1,6 @@
 #include "Def.hpp"
 #include "expr.hpp"
+#include "RE.hpp"
 #include <cstring>
 #include <cstdlib>
 #include <vector>
@@ -47,61 +48,39 @@ True::True() : ExprBase(E_TRUE) {}
 
 False::False() : ExprBase(E_FALSE) {}
 
-MakeVoid::MakeVoid() : ExprBase(E_VOID) {}
+MakeVoid::MakeVoid() : ExprBase(E_VOID), watch(&unwatched) {}
 
-Exit::Exit() : ExprBase(E_EXIT) {}
+Exit::Exit() : ExprBase(E_EXIT), watch(&unwatched) {}
 
 //BASIC ABSTRACT TYPES FOR PARAMETERS
 
-Unary::Unary(ExprType et, const Expr &expr) : ExprBase(et), rand(expr) {}
+Unary::Unary(ExprType et, const Expr &expr) : ExprBase(et), watch(&unwatched), rand(expr) {}
 
-Binary::Binary(ExprType et, const Expr &r1, const Expr &r2) : ExprBase(et), rand1(r1), rand2(r2) {}
+Binary::Binary(ExprType et, const Expr &r1, const Expr &r2) : ExprBase(et), watch(&unwatched), rand1(r1), rand2(r2) {}
 
-Variadic::Variadic(ExprType et, const std::vector<Expr> &rands) : ExprBase(et), rands(rands) {}
+Variadic::Variadic(ExprType et, const std::vector<Expr> &rands) : ExprBase(et), watch(&unwatched), rands(rands) {}
 
 //ARITHMETIC OPERATIONS
 
-Plus::Plus(const Expr &r1, const Expr &r2) : Binary(E_PLUS, r1, r2) {}
-
-Minus::Minus(const Expr &r1, const Expr &r2) : Binary(E_MINUS, r1, r2) {}
-
-Mult::Mult(const Expr &r1, const Expr &r2) : Binary(E_MUL, r1, r2) {}
-
-Div::Div(const Expr &r1, const Expr &r2) : Binary(E_DIV, r1, r2) {}
-
 Modulo::Modulo(const Expr &r1, const Expr &r2) : Binary(E_MODULO, r1, r2) {}
 
 Expt::Expt(const Expr &r1, const Expr &r2) : Binary(E_EXPT, r1, r2) {}
 
-PlusVar::PlusVar(const std::vector<Expr> &rands) : Variadic(E_PLUS, rands) {}
-
-MinusVar::MinusVar(const std::vector<Expr> &rands) : Variadic(E_MINUS, rands) {}
-
-MultVar::MultVar(const std::vector<Expr> &rands) : Variadic(E_MUL, rands) {}
-
-DivVar::DivVar(const std::vector<Expr> &rands) : Variadic(E_DIV, rands) {}
+//NUMBER THEORY
 
-//COMPARISON OPERATIONS
+Quotient::Quotient(const Expr &r1, const Expr &r2) : Binary(E_QUOTIENT, r1, r2) {}
 
-Less::Less(const Expr &r1, const Expr &r2) : Binary(E_LT, r1, r2) {}
+Remainder::Remainder(const Expr &r1, const Expr &r2) : Binary(E_REMAINDER, r1, r2) {}
 
-LessEq::LessEq(const Expr &r1, const Expr &r2) : Binary(E_LE, r1, r2) {}
+Gcd::Gcd(const std::vector<Expr> &rands) : Variadic(E_GCD, rands) {}
 
-Equal::Equal(const Expr &r1, const Expr &r2) : Binary(E_EQ, r1, r2) {}
+Lcm::Lcm(const std::vector<Expr> &rands) : Variadic(E_LCM, rands) {}
 
-GreaterEq::GreaterEq(const Expr &r1, const Expr &r2) : Binary(E_GE, r1, r2) {}
+ExactIntSqrt::ExactIntSqrt(const Expr &r) : Unary(E_EXACT_INT_SQRT, r) {}
 
-Greater::Greater(const Expr &r1, const Expr &r2) : Binary(E_GT, r1, r2) {}
+ExptMod::ExptMod(const std::vector<Expr> &rands) : Variadic(E_EXPT_MOD, rands) {}
 
-LessVar::LessVar(const std::vector<Expr> &rands) : Variadic(E_LT, rands) {}
-
-LessEqVar::LessEqVar(const std::vector<Expr> &rands) : Variadic(E_LE, rands) {}
-
-EqualVar::EqualVar(const std::vector<Expr> &rands) : Variadic(E_EQ, rands) {}
-
-GreaterEqVar::GreaterEqVar(const std::vector<Expr> &rands) : Variadic(E_GE, rands) {}
-
-GreaterVar::GreaterVar(const std::vector<Expr> &rands) : Variadic(E_GT, rands) {}
+IsPrime::IsPrime(const Expr &r) : Unary(E_PRIMEQ, r) {}
 
 //LIST OPERATIONS
 
@@ -111,24 +90,42 @@ Car::Car(const Expr &r1) : Unary(E_CAR, r1) {}
 
 Cdr::Cdr(const Expr &r1) : Unary(E_CDR, r1) {}
 
+UncheckedCar::UncheckedCar(const Expr &r1) : Car(r1) {}
+
+UncheckedCdr::UncheckedCdr(const Expr &r1) : Cdr(r1) {}
+
 ListFunc::ListFunc(const std::vector<Expr> &rands) : Variadic(E_LIST, rands) {}
 
 SetCar::SetCar(const Expr &r1, const Expr &r2) : Binary(E_SETCAR, r1, r2) {}
 
 SetCdr::SetCdr(const Expr &r1, const Expr &r2) : Binary(E_SETCDR, r1, r2) {}
 
+MemberFunc::MemberFunc(const Expr &r1, const Expr &r2) : Binary(E_MEMBER, r1, r2) {}
+
+AssocFunc::AssocFunc(const Expr &r1, const Expr &r2) : Binary(E_ASSOC, r1, r2) {}
+
+Map::Map(const Expr &r1, const Expr &r2) : Binary(E_MAP, r1, r2) {}
+
+Filter::Filter(const Expr &r1, const Expr &r2) : Binary(E_FILTER, r1, r2) {}
+
+Fold::Fold(const std::vector<Expr> &rands) : Variadic(E_FOLD, rands) {}
+
 //LOGIC OPERATIONS
 
 Not::Not(const Expr &r1) : Unary(E_NOT, r1) {}
 
-AndVar::AndVar(const std::vector<Expr> &rands) : ExprBase(E_AND), rands(rands) {}
+AndVar::AndVar(const std::vector<Expr> &rands) : ExprBase(E_AND), watch(&unwatched), rands(rands) {}
 
-OrVar::OrVar(const std::vector<Expr> &rands) : ExprBase(E_OR), rands(rands) {}
+OrVar::OrVar(const std::vector<Expr> &rands) : ExprBase(E_OR), watch(&unwatched), rands(rands) {}
 
 //TYPE PREDICATES
 
 IsEq::IsEq(const Expr &r1, const Expr &r2) : Binary(E_EQQ, r1, r2) {}
 
+IsEqv::IsEqv(const Expr &r1, const Expr &r2) : Binary(E_EQVQ, r1, r2) {}
+
+IsEqual::IsEqual(const Expr &r1, const Expr &r2) : Binary(E_EQUALQ, r1, r2) {}
+
 IsBoolean::IsBoolean(const Expr &r1) : Unary(E_BOOLQ, r1) {}
 
 IsFixnum::IsFixnum(const Expr &r1) : Unary(E_INTQ, r1) {}
@@ -157,16 +154,60 @@ If::If(const Expr &c, const Expr &c_t, const Expr &c_e) : ExprBase(E_IF), cond(c
 
 Cond::Cond(const std::vector<std::vector<Expr>> &cls) : ExprBase(E_COND), clauses(cls) {}
 
+Case::Case(const Expr &k) : ExprBase(E_CASE), key(k), jump_base(0), null_clause(-1), else_clause(-1) {
+    booleans[0] = booleans[1] = -1;
+}
+
+// Earlier clauses win when a datum is repeated
+void Case::addFixnum(int n, int clause) {
+    fixnums.insert(std::make_pair(n, clause));
+}
+
+// Rationals are keyed reduced; a whole one is a fixnum datum
+void Case::addRational(int num, int den, int clause) {
+    if (den == 0) throw RuntimeError("case: rational datum with zero denominator");
+    if (den < 0) { num = -num; den = -den; }
+    int a = num < 0 ? -num : num, b = den;
+    while (b != 0) { int t = a % b; a = b; b = t; }
+    num /= a;
+    den /= a;
+    if (den == 1) addFixnum(num, clause);
+    else rationals.insert(std::make_pair(std::make_pair(num, den), clause));
+}
+
+// Use a dense table when the fixnum datums cover a small range
+void Case::buildJumpTable() {
+    if (fixnums.empty()) return;
+    long lo = fixnums.begin()->first, hi = lo;
+    for (auto &kv : fixnums) {
+        if (kv.first < lo) lo = kv.first;
+        if (kv.first > hi) hi = kv.first;
+    }
+    long span = hi - lo + 1;
+    if (span > 1024 || span > 4 * (long)fixnums.size() + 16) return;
+    jump.assign(span, -1);
+    jump_base = (int)lo;
+    for (auto &kv : fixnums) jump[kv.first - lo] = kv.second;
+}
+
 //VARIABLE AND FUNCITON DEFINITION
 
 Var::Var(const string &s) : ExprBase(E_VAR), x(s) {}
 
-Apply::Apply(const Expr &expr, const vector<Expr> &vec) : ExprBase(E_APPLY), rator(expr), rand(vec) {}
+Apply::Apply(const Expr &expr, const vector<Expr> &vec)
+    : ExprBase(E_APPLY), rator(expr), rand(vec), known(nullptr), known_hops(0), global_epoch(0),
+      cache_hits(0), cache_misses(0), unchecked(false) {}
 
-Lambda::Lambda(const vector<string> &vec, const Expr &expr) : ExprBase(E_LAMBDA), x(vec), e(expr) {}
+Lambda::Lambda(const vector<string> &vec, const Expr &expr)
+    : ExprBase(E_LAMBDA), x(vec), e(expr), closed(false), lift_hops(0) {}
 
 Define::Define(const string &variable, const Expr &expr) : ExprBase(E_DEFINE), var(variable), e(expr) {}
 
+NativeCode::NativeCode(Value (*f)(Assoc &)) : ExprBase(E_NATIVE), fn(f) {}
+
+LazyBody::LazyBody(const string &src, const vector<string> &ps, bool unchecked)
+    : ExprBase(E_LAZY_BODY), source(src), params(ps), body(nullptr), unchecked(unchecked) {}
+
 //BINDING CONSTRUCTS
 
 Let::Let(const vector<pair<string, Expr>> &vec, const Expr &e) : ExprBase(E_LET), bind(vec), body(e) {}
@@ -179,4 +220,44 @@ Set::Set(const std::string &var, const Expr &e) : ExprBase(E_SET), var(var), e(e
 
 //I/O OPERATIONS
 
-Display::Display(const Expr &r) : Unary(E_DISPLAY, r) {}
\ No newline at end of file
+Display::Display(const Expr &r) : Unary(E_DISPLAY, r) {}
+
+//ENVIRONMENT SNAPSHOTS
+
+MakeCheckpoint::MakeCheckpoint() : ExprBase(E_CHECKPOINT), watch(&unwatched) {}
+
+Rollback::Rollback(const Expr &r) : ExprBase(E_ROLLBACK), watch(&unwatched), id(r) {}
+
+//EXCEPTIONS
+
+Raise::Raise(const Expr &r) : Unary(E_RAISE, r) {}
+
+RaiseContinuable::RaiseContinuable(const Expr &r) : Unary(E_RAISE_CONTINUABLE, r) {}
+
+ErrorFunc::ErrorFunc(const std::vector<Expr> &rands) : Variadic(E_ERROR, rands) {}
+
+WithHandler::WithHandler(const Expr &r1, const Expr &r2) : Binary(E_WITH_HANDLER, r1, r2) {}
+
+IsErrorObject::IsErrorObject(const Expr &r) : Unary(E_ERRORQ, r) {}
+
+ErrorObjectMessage::ErrorObjectMessage(const Expr &r) : Unary(E_ERROR_MESSAGE, r) {}
+
+ErrorObjectIrritants::ErrorObjectIrritants(const Expr &r) : Unary(E_ERROR_IRRITANTS, r) {}
+
+Guard::Guard(const string &v, const vector<pair<Expr, Expr>> &cls, const vector<bool> &rcv, const Expr &b)
+    : ExprBase(E_GUARD), var(v), clauses(cls), receivers(rcv), body(b) {}
+//OPTIMIZER NODES
+
+UnboxedFixnum::UnboxedFixnum(ExprType t, const Expr &g)
+    : ExprBase(t), generic(g), root(0), cmp(E_EQQ), lhs(0), rhs(0) {}
+
+MakeBox::MakeBox(const Expr &e) : ExprBase(E_MAKE_BOX), e(e) {}
+
+BoxRef::BoxRef(const string &s) : ExprBase(E_BOX_REF), x(s) {}
+
+BoxSet::BoxSet(const string &var, const Expr &e) : ExprBase(E_BOX_SET), var(var), e(e) {}
+
+ListPipeline::ListPipeline(const Expr &g, const Expr &src)
+    : ExprBase(E_LIST_PIPELINE), generic(g), source(src), kons(nullptr), knil(nullptr) {}
+
+Constant::Constant(const std::shared_ptr<ValueBase> &v) : ExprBase(E_CONSTANT), value(v) {}
@@ -21,7 +21,10 @@ public:
 #include "syntax.hpp"
 #include <memory>
 #include <cstring>
+#include <cstdint>
 #include <vector>
+#include <map>
+#include <unordered_map>
 
 struct ExprBase{
     ExprType e_type;
@@ -90,12 +93,65 @@ struct False : ExprBase {
   virtual Value eval(Assoc &) override;
 };
 
+// ================================================================================
+//                             PRIMITIVE WATCHPOINTS
+// ================================================================================
+
+/**
+ * @brief Redefinition watchpoint on the global name of a primitive
+ *
+ * The parser builds a primitive's node only when its name is unbound, and
+ * registers the node against the name's watch. Binding the name with define
+ * fires the watch for good; from then on every node registered against it
+ * looks the name up on each evaluation and, where it is bound, calls that
+ * procedure like an Apply would. Where it is still unbound the node keeps
+ * its primitive behaviour.
+ */
+struct PrimitiveWatch {
+    std::string name;
+    bool fired;         ///< Some define has bound the name
+};
+
+extern PrimitiveWatch unwatched;            ///< Never fires: nodes built outside the parser
+extern unsigned primitive_redefinitions;    ///< Watches fired so far
+
+/**
+ * @brief The watch of a primitive's name, created on first use
+ */
+PrimitiveWatch *primitiveWatch(const std::string &);
+
+/**
+ * @brief Fire the watch of a name being bound by define, if it names a primitive
+ */
+void firePrimitiveWatch(const std::string &);
+
+/**
+ * @brief Watches an optimized node or compiled body relies on
+ *
+ * Code derived from primitive nodes (UnboxedFixnum, ListPipeline, JIT code)
+ * assumes what those primitives compute and must fall back once one fires.
+ */
+struct WatchSet {
+    std::vector<const PrimitiveWatch*> watches;
+    void add(const PrimitiveWatch *w) {
+        for (auto x : watches) if (x == w) return;
+        watches.push_back(w);
+    }
+    bool fired() const {
+        if (primitive_redefinitions == 0) return false;
+        for (auto w : watches) if (w->fired) return true;
+        return false;
+    }
+};
+
 struct MakeVoid : ExprBase {
+    const PrimitiveWatch *watch;
     MakeVoid();
     virtual Value eval(Assoc &) override;
 };
 
 struct Exit : ExprBase {
+    const PrimitiveWatch *watch;
     Exit();
     virtual Value eval(Assoc &) override;
 };
@@ -104,7 +160,12 @@ struct Exit : ExprBase {
 //                             BASIC ABSTRACT TYPES FOR PARAMETERS
 // ================================================================================
 
+/**
+ * Primitive nodes built by the parser are registered against the watch of
+ * their name (see PrimitiveWatch); others are unwatched.
+ */
 struct Unary : ExprBase {
+    const PrimitiveWatch *watch;
     Expr rand;
     Unary(ExprType, const Expr &);
     virtual Value evalRator(const Value &) = 0;
@@ -112,6 +173,7 @@ struct Unary : ExprBase {
 };
 
 struct Binary : ExprBase {
+    const PrimitiveWatch *watch;
     Expr rand1;
     Expr rand2;
     Binary(ExprType, const Expr &, const Expr &);
@@ -120,6 +182,7 @@ struct Binary : ExprBase {
 };
 
 struct Variadic : ExprBase {
+    const PrimitiveWatch *watch;
     std::vector<Expr> rands;
     Variadic(ExprType, const std::vector<Expr> &);
     virtual Value evalRator(const std::vector<Value> &) = 0;
@@ -130,26 +193,72 @@ struct Variadic : ExprBase {
 //                             ARITHMETIC OPERATIONS
 // ================================================================================
 
-struct Plus : Binary {
-    Plus(const Expr &, const Expr &);
-    virtual Value evalRator(const Value &, const Value &) override;
+/**
+ * @brief Policy of one arithmetic or comparison operation
+ *
+ * The kernels are defined in evaluation.cpp, over a numeric tower in which
+ * a fixnum is the rational n/1:
+ *  - fixnum(a, b): both operands are fixnums; arithmetic wraps at 32 bits,
+ *    as the JIT's does;
+ *  - rational(an, ad, bn, bd): any other pair of numbers, denominators
+ *    positive, computed exactly in 64 bits.
+ * numericApply() dispatches on the pair of operand types for every node
+ * below, so a new numeric type is added there once.
+ */
+template <ExprType T>
+struct NumericOp {
+    static const ExprType type = T;
+    static const bool chained =             ///< Variadic form compares neighbours
+        T == E_LT || T == E_LE || T == E_EQ || T == E_GE || T == E_GT;
+    static const bool nullary = T == E_PLUS || T == E_MUL;     ///< (op) is the unit
+    static const int unit = T == E_MUL || T == E_DIV ? 1 : 0;  ///< (op x) is (op unit x)
+    static Value fixnum(int, int);
+    static Value rational(int64_t, int64_t, int64_t, int64_t);
 };
 
-struct Minus : Binary {
-    Minus(const Expr &, const Expr &);
+/**
+ * @brief Two-operand node of an operation
+ *
+ * Each instantiation is compiled on its own, so the type-pair dispatch and
+ * the kernels inline into one evalRator per operation.
+ */
+template <typename Op>
+struct NumericBinary : Binary {
+    NumericBinary(const Expr &r1, const Expr &r2) : Binary(Op::type, r1, r2) {}
     virtual Value evalRator(const Value &, const Value &) override;
 };
 
-struct Mult : Binary {
-    Mult(const Expr &, const Expr &);
-    virtual Value evalRator(const Value &, const Value &) override;
+/**
+ * @brief Any-operand node of an operation
+ *
+ * Arithmetic folds from the left and comparisons hold if they hold for
+ * each pair of neighbours. Every operand must be a number.
+ */
+template <typename Op>
+struct NumericVariadic : Variadic {
+    NumericVariadic(const std::vector<Expr> &rands) : Variadic(Op::type, rands) {}
+    virtual Value evalRator(const std::vector<Value> &) override;
 };
 
-struct Div : Binary {
-    Div(const Expr &, const Expr &);
+/**
+ * @brief Two-operand node whose operands are assumed to be numbers (see unsafe_mode)
+ */
+template <typename Op>
+struct UncheckedBinary : NumericBinary<Op> {
+    UncheckedBinary(const Expr &r1, const Expr &r2) : NumericBinary<Op>(r1, r2) {}
     virtual Value evalRator(const Value &, const Value &) override;
 };
 
+typedef NumericBinary<NumericOp<E_PLUS> > Plus;
+typedef NumericBinary<NumericOp<E_MINUS> > Minus;
+typedef NumericBinary<NumericOp<E_MUL> > Mult;
+typedef NumericBinary<NumericOp<E_DIV> > Div;
+
+typedef NumericVariadic<NumericOp<E_PLUS> > PlusVar;
+typedef NumericVariadic<NumericOp<E_MINUS> > MinusVar;
+typedef NumericVariadic<NumericOp<E_MUL> > MultVar;
+typedef NumericVariadic<NumericOp<E_DIV> > DivVar;
+
 struct Modulo : Binary {
     Modulo(const Expr &, const Expr &);
     virtual Value evalRator(const Value &, const Value &) override;
@@ -160,80 +269,102 @@ struct Expt : Binary {
     virtual Value evalRator(const Value &, const Value &) override;
 };
 
-struct PlusVar : Variadic {
-    PlusVar(const std::vector<Expr> &);
-    virtual Value evalRator(const std::vector<Value> &) override;
-};
-
-struct MinusVar : Variadic {
-    MinusVar(const std::vector<Expr> &);
-    virtual Value evalRator(const std::vector<Value> &) override;
-};
-
-struct MultVar : Variadic {
-    MultVar(const std::vector<Expr> &);
-    virtual Value evalRator(const std::vector<Value> &) override;
-};
-
-struct DivVar : Variadic {
-    DivVar(const std::vector<Expr> &);
-    virtual Value evalRator(const std::vector<Value> &) override;
-};
-
 // ================================================================================
-//                             COMPARISON OPERATIONS
+//                                NUMBER THEORY
 // ================================================================================
 
-struct Less : Binary {
-    Less(const Expr &, const Expr &);
-    virtual Value evalRator(const Value &, const Value &) override;
-};
-
-struct LessEq : Binary {
-    LessEq(const Expr &, const Expr &);
-    virtual Value evalRator(const Value &, const Value &) override;
-};
-
-struct Equal : Binary {
-    Equal(const Expr &, const Expr &);
-    virtual Value evalRator(const Value &, const Value &) override;
-};
-
-struct GreaterEq : Binary {
-    GreaterEq(const Expr &, const Expr &);
+/**
+ * @brief Fixnum kernels computed natively instead of in interpreted Scheme
+ *
+ * All operands must be integers. quotient truncates toward zero and
+ * remainder takes the sign of the dividend. gcd and lcm take any number of
+ * arguments and are never negative. (exact-integer-sqrt k) returns the list
+ * (s r) with s*s + r = k, since the interpreter has no multiple values.
+ * (expt-mod b e m) is b^e mod m in [0, m). A result that does not fit a
+ * fixnum is a RuntimeError.
+ */
+struct Quotient : Binary {
+    Quotient(const Expr &, const Expr &);
     virtual Value evalRator(const Value &, const Value &) override;
 };
 
-struct Greater : Binary {
-    Greater(const Expr &, const Expr &);
+struct Remainder : Binary {
+    Remainder(const Expr &, const Expr &);
     virtual Value evalRator(const Value &, const Value &) override;
 };
 
-struct LessVar : Variadic {
-    LessVar(const std::vector<Expr> &);
+struct Gcd : Variadic {
+    Gcd(const std::vector<Expr> &);
     virtual Value evalRator(const std::vector<Value> &) override;
 };
 
-struct LessEqVar : Variadic {
-    LessEqVar(const std::vector<Expr> &);
+struct Lcm : Variadic {
+    Lcm(const std::vector<Expr> &);
     virtual Value evalRator(const std::vector<Value> &) override;
 };
 
-struct EqualVar : Variadic {
-    EqualVar(const std::vector<Expr> &);
-    virtual Value evalRator(const std::vector<Value> &) override;
+struct ExactIntSqrt : Unary {
+    ExactIntSqrt(const Expr &);
+    virtual Value evalRator(const Value &) override;
 };
 
-struct GreaterEqVar : Variadic {
-    GreaterEqVar(const std::vector<Expr> &);
+struct ExptMod : Variadic {
+    ExptMod(const std::vector<Expr> &);
     virtual Value evalRator(const std::vector<Value> &) override;
 };
 
-struct GreaterVar : Variadic {
-    GreaterVar(const std::vector<Expr> &);
-    virtual Value evalRator(const std::vector<Value> &) override;
+struct IsPrime : Unary {
+    IsPrime(const Expr &);
+    virtual Value evalRator(const Value &) override;
 };
 
+// ================================================================================
+//                             COMPARISON OPERATIONS
+// ================================================================================
+
+// Generated from NumericOp like the arithmetic nodes
+
+typedef NumericBinary<NumericOp<E_LT> > Less;
+typedef NumericBinary<NumericOp<E_LE> > LessEq;
+typedef NumericBinary<NumericOp<E_EQ> > Equal;
+typedef NumericBinary<NumericOp<E_GE> > GreaterEq;
+typedef NumericBinary<NumericOp<E_GT> > Greater;
+
+typedef NumericVariadic<NumericOp<E_LT> > LessVar;
+typedef NumericVariadic<NumericOp<E_LE> > LessEqVar;
+typedef NumericVariadic<NumericOp<E_EQ> > EqualVar;
+typedef NumericVariadic<NumericOp<E_GE> > GreaterEqVar;
+typedef NumericVariadic<NumericOp<E_GT> > GreaterVar;
+
+// Instantiated once, in evaluation.cpp
+extern template struct NumericBinary<NumericOp<E_PLUS> >;
+extern template struct NumericBinary<NumericOp<E_MINUS> >;
+extern template struct NumericBinary<NumericOp<E_MUL> >;
+extern template struct NumericBinary<NumericOp<E_DIV> >;
+extern template struct NumericBinary<NumericOp<E_LT> >;
+extern template struct NumericBinary<NumericOp<E_LE> >;
+extern template struct NumericBinary<NumericOp<E_EQ> >;
+extern template struct NumericBinary<NumericOp<E_GE> >;
+extern template struct NumericBinary<NumericOp<E_GT> >;
+extern template struct NumericVariadic<NumericOp<E_PLUS> >;
+extern template struct NumericVariadic<NumericOp<E_MINUS> >;
+extern template struct NumericVariadic<NumericOp<E_MUL> >;
+extern template struct NumericVariadic<NumericOp<E_DIV> >;
+extern template struct NumericVariadic<NumericOp<E_LT> >;
+extern template struct NumericVariadic<NumericOp<E_LE> >;
+extern template struct NumericVariadic<NumericOp<E_EQ> >;
+extern template struct NumericVariadic<NumericOp<E_GE> >;
+extern template struct NumericVariadic<NumericOp<E_GT> >;
+extern template struct UncheckedBinary<NumericOp<E_PLUS> >;
+extern template struct UncheckedBinary<NumericOp<E_MINUS> >;
+extern template struct UncheckedBinary<NumericOp<E_MUL> >;
+extern template struct UncheckedBinary<NumericOp<E_DIV> >;
+extern template struct UncheckedBinary<NumericOp<E_LT> >;
+extern template struct UncheckedBinary<NumericOp<E_LE> >;
+extern template struct UncheckedBinary<NumericOp<E_EQ> >;
+extern template struct UncheckedBinary<NumericOp<E_GE> >;
+extern template struct UncheckedBinary<NumericOp<E_GT> >;
+
 // ================================================================================
 //                             LIST OPERATIONS
 // ================================================================================
@@ -253,6 +384,19 @@ struct Cdr : Unary {
     virtual Value evalRator(const Value &) override;
 };
 
+/**
+ * @brief car and cdr of a value assumed to be a pair (see unsafe_mode)
+ */
+struct UncheckedCar : Car {
+    UncheckedCar(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct UncheckedCdr : Cdr {
+    UncheckedCdr(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
 struct ListFunc : Variadic {
     ListFunc(const std::vector<Expr> &);
     virtual Value evalRator(const std::vector<Value> &) override;
@@ -268,6 +412,50 @@ struct SetCdr : Binary {
     virtual Value evalRator(const Value &, const Value &) override;
 };
 
+/**
+ * @brief (member x lst): the first sublist whose car is equal? to x, or #f
+ */
+struct MemberFunc : Binary {
+    MemberFunc(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+/**
+ * @brief (assoc key alist): the first pair whose car is equal? to key, or #f
+ */
+struct AssocFunc : Binary {
+    AssocFunc(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+// ================================================================================
+//                             LIST COMBINATORS
+// ================================================================================
+
+/**
+ * @brief (map proc list)
+ */
+struct Map : Binary {
+    Map(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+/**
+ * @brief (filter pred list)
+ */
+struct Filter : Binary {
+    Filter(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+/**
+ * @brief (fold kons knil list), calling (kons element accumulator) left to right
+ */
+struct Fold : Variadic {
+    Fold(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
 // ================================================================================
 //                             LOGIC OPERATIONS
 // ================================================================================
@@ -278,12 +466,14 @@ struct Not : Unary {
 };
 
 struct AndVar : ExprBase {
+    const PrimitiveWatch *watch;
     std::vector<Expr> rands;
     AndVar(const std::vector<Expr> &);
     virtual Value eval(Assoc &) override;  
 };
 
 struct OrVar : ExprBase {
+    const PrimitiveWatch *watch;
     std::vector<Expr> rands;
     OrVar(const std::vector<Expr> &);
     virtual Value eval(Assoc &) override;
@@ -298,6 +488,16 @@ struct IsEq : Binary {
     virtual Value evalRator(const Value &, const Value &) override;
 };
 
+struct IsEqv : Binary {
+    IsEqv(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+struct IsEqual : Binary {
+    IsEqual(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
 struct IsBoolean : Unary {
     IsBoolean(const Expr &);
     virtual Value evalRator(const Value &) override;
@@ -372,6 +572,36 @@ struct Cond : ExprBase {
     virtual Value eval(Assoc &) override;
 };
 
+/**
+ * @brief (case key ((datum...) expr...) ... (else expr...))
+ *
+ * Datums are resolved at parse time into dispatch tables keyed by the
+ * datum, so selecting a clause costs one lookup however many there are.
+ * Fixnum datums use a dense jump table when their range is small. The
+ * body of a ((datum...) => receiver) clause is the receiver, called with
+ * the key.
+ */
+struct Case : ExprBase {
+    Expr key;
+    std::vector<Expr> bodies;                       ///< Clause bodies, in source order
+    std::vector<bool> receivers;                    ///< Clause i is (datums => receiver)
+    std::unordered_map<int, int> fixnums;           ///< Fixnum datum -> clause
+    std::vector<int> jump;                          ///< Dense fixnum table, -1 for no clause
+    int jump_base;                                  ///< Fixnum held by jump[0]
+    std::map<std::pair<int, int>, int> rationals;   ///< Reduced rational datum -> clause
+    std::unordered_map<std::string, int> symbols;   ///< Symbol datum -> clause
+    int booleans[2];                                ///< Clause for #f and #t
+    int null_clause;                                ///< Clause for ()
+    int else_clause;                                ///< Clause for else, -1 if absent
+    Case(const Expr &);
+    void addFixnum(int, int);
+    void addRational(int, int, int);
+    void buildJumpTable();
+    int selectFixnum(int);
+    int select(const Value &);
+    virtual Value eval(Assoc &) override;
+};
+
 // ================================================================================
 //                             VARIABLE AND FUNCITION DEFINITION
 // ================================================================================
@@ -382,17 +612,134 @@ struct Var : ExprBase {
     virtual Value eval(Assoc &) override;
 };
 
+struct Lambda;
+struct Procedure;
+
+/**
+ * @brief Procedure call
+ *
+ * analyzeBindings() (optimize.hpp) may mark the call site as known:
+ *  - known: the operator is a letrec-bound lambda that is never set!; its
+ *    closure sits known_hops bindings down the call environment, and its
+ *    arity was checked against the arguments at parse time;
+ *  - global: the operator is a global variable whose binding node is cached,
+ *    valid while env_epoch is unchanged.
+ *
+ * Other calls go through an inline cache of up to CALL_CACHE_WAYS procedure
+ * codes seen at the site, all with the site's arity. A procedure whose code
+ * is cached is applied without the dynamic_cast and arity check.
+ *
+ * An unchecked call (see unsafe_mode) skips the cache and both checks.
+ */
+const size_t CALL_CACHE_WAYS = 4;
+
 struct Apply : ExprBase {
     Expr rator;
     std::vector<Expr> rand;
+    Lambda *known;                          ///< Callee of a known call, or null
+    size_t known_hops;                      ///< Bindings between the call environment and the callee
+    std::shared_ptr<AssocList> global;      ///< Cached global binding of the operator, or null
+    unsigned global_epoch;                  ///< env_epoch when global was cached
+    std::vector<std::shared_ptr<const ProcedureCode>> cache;   ///< Codes seen here; held so their addresses stay unique
+    unsigned long cache_hits;
+    unsigned long cache_misses;
+    bool unchecked;                         ///< Parsed in unchecked code
     Apply(const Expr &, const std::vector<Expr> &);
     virtual Value eval(Assoc &) override;
 };
 
+/**
+ * @brief Apply a procedure value to already evaluated arguments
+ */
+Value applyProcedure(const Value &, const std::vector<Value> &);
+
+/**
+ * @brief Apply a procedure already known to take this many arguments
+ */
+Value applyClosure(Procedure *, const std::vector<Value> &);
+
+/**
+ * @brief Procedure body compiled ahead of time by scheme2cxx
+ */
+struct NativeCode : ExprBase {
+    Value (*fn)(Assoc &);
+    NativeCode(Value (*)(Assoc &));
+    virtual Value eval(Assoc &) override;
+};
+
+/**
+ * @brief Lambda expression
+ *
+ * liftLambdas() (optimize.hpp) marks a lambda closed when its body refers
+ * to no local variable of the enclosing code. A closed lambda's procedure
+ * captures only the global part of the environment, lift_hops bindings
+ * down, and is created once and shared while that part is unchanged.
+ *
+ * The body of a lambda outside any local scope is a LazyBody until the
+ * procedure is first called.
+ *
+ * Every procedure the lambda evaluates to shares one ProcedureCode. The
+ * passes may still rewrite x and e after parsing, so it is made at the
+ * first eval, once the form has been optimized.
+ */
 struct Lambda : ExprBase {
     std::vector<std::string> x;
     Expr e;
+    bool closed;                            ///< Refers to no enclosing local variable
+    size_t lift_hops;                       ///< Local bindings in scope where it is evaluated
+    std::shared_ptr<ValueBase> lifted;      ///< Shared procedure of a closed lambda
+    std::shared_ptr<const ProcedureCode> code;  ///< Made from x and e at the first eval
     Lambda(const std::vector<std::string> &, const Expr &);
+    ~Lambda();
+    virtual Value eval(Assoc &) override;
+};
+
+/**
+ * @brief Release the shared procedures of every closed lambda
+ *
+ * A shared procedure keeps the global environment it captured alive; the
+ * server calls this after each request so a request's bindings can die.
+ */
+void dropLiftedProcedures();
+
+/**
+ * @brief Parse lambda bodies only when first called (default on)
+ *
+ * Batch mode and scheme2cxx turn it off: they rewrite or translate whole
+ * forms before evaluating anything.
+ */
+extern bool lazy_lambda_bodies;
+
+/**
+ * @brief Parse every form as unchecked code (`code --unsafe`)
+ *
+ * Unchecked code gets the check-free variants of calls, car, cdr and
+ * two-operand arithmetic and comparisons: they assume the operator is a
+ * procedure of the right arity, the operand is a pair, the operands are
+ * numbers. A program that breaks an assumption has undefined behaviour,
+ * so it is meant for code already run in the default mode.
+ *
+ * Without it, a lambda whose body is preceded by (declare (unsafe)) has
+ * that body parsed as unchecked code, nested lambdas included.
+ */
+extern bool unsafe_mode;
+
+/**
+ * @brief Body of a top-level lambda, parsed and optimized on its first call
+ *
+ * Such a lambda refers to no local variable but its own parameters, so its
+ * body can be parsed later, against the environment the procedure captured,
+ * and optimized as a form of its own. Until then only the body's source
+ * text is kept, which is far smaller than its syntax tree. A body that
+ * fails to parse raises its RuntimeError at every call and stays unparsed.
+ */
+struct LazyBody : ExprBase {
+    std::string source;                 ///< Body text, until parsed
+    std::vector<std::string> params;    ///< Parameters of the lambda
+    Expr body;                          ///< Parsed body, or null
+    bool unchecked;                     ///< Parse as unchecked code (declare (unsafe))
+    LazyBody(const std::string &, const std::vector<std::string> &, bool);
+    void force(Assoc &);
     virtual Value eval(Assoc &) override;
 };
 
@@ -441,4 +788,187 @@ struct Display : Unary {
     virtual Value evalRator(const Value &) override;
 };
 
+// ================================================================================
+//                              ENVIRONMENT SNAPSHOTS
+// ================================================================================
+
+/**
+ * @brief (checkpoint): snapshot the environment, returning the checkpoint id
+ */
+struct MakeCheckpoint : ExprBase {
+    const PrimitiveWatch *watch;
+    MakeCheckpoint();
+    virtual Value eval(Assoc &) override;
+};
+
+/**
+ * @brief (rollback id): restore the environment and mutable values to a checkpoint
+ */
+struct Rollback : ExprBase {
+    const PrimitiveWatch *watch;
+    Expr id;
+    Rollback(const Expr &);
+    virtual Value eval(Assoc &) override;
+};
+
+// ================================================================================
+//                              EXCEPTIONS
+// ================================================================================
+
+/**
+ * @brief (raise obj): non-continuable raise
+ */
+struct Raise : Unary {
+    Raise(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+/**
+ * @brief (raise-continuable obj): the handler's result becomes the value of the raise
+ */
+struct RaiseContinuable : Unary {
+    RaiseContinuable(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+/**
+ * @brief (error msg irritant...): raise a new error object
+ */
+struct ErrorFunc : Variadic {
+    ErrorFunc(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+/**
+ * @brief (with-exception-handler handler thunk)
+ */
+struct WithHandler : Binary {
+    WithHandler(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+struct IsErrorObject : Unary {
+    IsErrorObject(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct ErrorObjectMessage : Unary {
+    ErrorObjectMessage(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct ErrorObjectIrritants : Unary {
+    ErrorObjectIrritants(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+/**
+ * @brief (guard (var clause...) body...)
+ * Each clause is a test and an optional body; a missing body yields the test value.
+ * In a (test => receiver) clause the body is the receiver, called with the test value.
+ */
+struct Guard : ExprBase {
+    std::string var;
+    std::vector<std::pair<Expr, Expr>> clauses;
+    std::vector<bool> receivers;    ///< Clause i is (test => receiver)
+    Expr body;
+    Guard(const std::string &, const std::vector<std::pair<Expr, Expr>> &, const std::vector<bool> &, const Expr &);
+    virtual Value eval(Assoc &) override;
+};
+
+// ================================================================================
+//                              OPTIMIZER NODES
+// ================================================================================
+
+/**
+ * @brief One operation of an unboxed fixnum tree
+ */
+struct FixnumOp {
+    ExprType op;        ///< E_FIXNUM, E_VAR, E_PLUS, E_MINUS or E_MUL
+    int n;              ///< Literal value
+    size_t hops;        ///< Variable: bindings between the environment head and it
+    size_t lhs, rhs;    ///< Operation: operand indices into ops
+};
+
+/**
+ * @brief Fixnum arithmetic or comparison computed without boxing
+ *
+ * Built by inferFixnums() (optimize.hpp) over a subtree whose variables are
+ * proven to always hold fixnums. Intermediates are 64-bit; if one leaves
+ * the fixnum range the original subtree is evaluated instead, so overflow
+ * behaves exactly as in the generic path.
+ *  - E_UNBOXED_ARITH: ops[root] is boxed into an Integer.
+ *  - E_UNBOXED_TEST: compares ops[lhs] and ops[rhs] with cmp (E_LT ... E_GT
+ *    or E_EQQ); If tests it without building a Boolean.
+ * Once a primitive the proof relies on is redefined, generic is evaluated.
+ */
+struct UnboxedFixnum : ExprBase {
+    Expr generic;                   ///< Original subtree
+    WatchSet watches;               ///< + - * and the comparison
+    std::vector<FixnumOp> ops;      ///< Operands precede the operations using them
+    size_t root;                    ///< Arithmetic result
+    ExprType cmp;                   ///< Comparison of a test
+    size_t lhs, rhs;                ///< Compared operands of a test
+    UnboxedFixnum(ExprType, const Expr &);
+    bool compute(size_t, Assoc &, long long &);
+    bool test(Assoc &);
+    virtual Value eval(Assoc &) override;
+};
+
+/**
+ * @brief Boxed variables, built by convertAssignments() (optimize.hpp)
+ *
+ * A local variable that is the target of set! is bound to a Box holding
+ * its value. Every reference to it reads through the box and every set!
+ * writes into it, so the binding itself is never mutated.
+ */
+struct MakeBox : ExprBase {
+    Expr e;     ///< Initial value
+    MakeBox(const Expr &);
+    virtual Value eval(Assoc &) override;
+};
+
+struct BoxRef : ExprBase {
+    std::string x;
+    BoxRef(const std::string &);
+    virtual Value eval(Assoc &) override;
+};
+
+struct BoxSet : ExprBase {
+    std::string var;
+    Expr e;
+    BoxSet(const std::string &, const Expr &);
+    virtual Value eval(Assoc &) override;
+};
+
+/**
+ * @brief Nested map and filter calls, optionally ended by fold, run as one loop
+ *
+ * Built by fuseListPipelines() (optimize.hpp). Each element passes through
+ * every stage before the next one is read, so no intermediate list is
+ * built. Operands are evaluated in the same order as in the nested calls.
+ * Procedure calls from different stages are interleaved instead of done one
+ * stage at a time. If map, filter or fold has been redefined, the nested
+ * calls are evaluated instead.
+ */
+struct ListPipeline : ExprBase {
+    Expr generic;                                   ///< Original nested calls
+    WatchSet watches;                               ///< Of every fused call
+    Expr source;                                    ///< List read by the first stage
+    std::vector<std::pair<ExprType, Expr>> stages;  ///< E_MAP or E_FILTER and its procedure, first stage first
+    Expr kons, knil;                                ///< Ending fold's operands, or null to build a list
+    ListPipeline(const Expr &, const Expr &);
+    virtual Value eval(Assoc &) override;
+};
+
+/**
+ * @brief A value known when the form was parsed, such as a final global in
+ * batch mode (see substituteGlobals)
+ */
+struct Constant : ExprBase {
+    std::shared_ptr<ValueBase> value;
+    Constant(const std::shared_ptr<ValueBase> &);
+    virtual Value eval(Assoc &) override;
+};
+
 #endif
@@ -0,0 +1,595 @@
+/**
+ * @file jit.cpp
+ * @brief Template JIT emitting x86-64 code for hot fixnum procedures
+ *
+ * Each supported expression has a fixed machine-code template that leaves
+ * its result in eax. Binary operands are evaluated right to left, matching
+ * Binary::eval. Compiled functions have the signature
+ *
+ *     int64_t fn(const int64_t *args, JitFrame *frame)
+ *
+ * and return (1 << 32) | result on success or 0 on bailout.
+ */
+
+#include "jit.hpp"
+#include "expr.hpp"
+#include "RE.hpp"
+#include <unordered_map>
+#include <exception>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define SCHEME_JIT_X86_64 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef SCHEME_JIT_X86_64
+bool jit_enabled = true;
+#else
+bool jit_enabled = false;
+#endif
+unsigned jit_threshold = 100;
+JitReplay *jit_replay = nullptr;
+
+/**
+ * @brief Results of the calls a bailed-out body already made
+ */
+struct JitReplay {
+    AssocList *env;                             ///< Call environment being replayed
+    std::unordered_map<Apply*, Value> results;  ///< Call site -> recorded result
+    JitReplay *prev;                            ///< Enclosing replay
+};
+
+bool jitReplayed(Apply *site, Assoc &env, Value &result) {
+    if (jit_replay->env != env.get()) return false;
+    auto it = jit_replay->results.find(site);
+    if (it == jit_replay->results.end()) return false;
+    result = it->second;
+    return true;
+}
+
+#ifdef SCHEME_JIT_X86_64
+
+enum JitType { J_NONE, J_INT, J_BOOL };
+
+/**
+ * @brief A call from compiled code back into the runtime
+ */
+struct JitSite {
+    Apply *node;                  ///< Call expression
+    std::vector<bool> bool_args;  ///< Per argument: boxed as boolean, else fixnum
+};
+
+typedef int64_t (*JitFn)(const int64_t *, void *);
+
+/**
+ * @brief Compiled form of a procedure body
+ */
+struct JitCode {
+    JitFn fn;
+    size_t length;                ///< Bytes mapped at fn
+    JitType result;
+    std::vector<JitSite> sites;
+    WatchSet watches;             ///< Primitives compiled inline
+};
+
+/**
+ * @brief Per-invocation state shared between compiled code and its helpers
+ */
+struct JitFrame {
+    JitCode *code;
+    Assoc *env;                   ///< Closure environment of the procedure
+    std::vector<Value> results;   ///< Results of completed calls, by site
+    std::exception_ptr error;     ///< Exception raised inside a helper
+    JitFrame(JitCode *c, Assoc *e) : code(c), env(e) {}
+};
+
+/**
+ * @brief Per-body call counter and compiled code
+ *
+ * Erased by jitForget() when the code owning the body is destroyed, so an
+ * entry never outlives its body and a new body at the same address starts
+ * afresh.
+ */
+struct JitEntry {
+    unsigned calls;
+    bool tried;       ///< Compilation attempted
+    JitCode *code;
+    JitEntry() : calls(0), tried(false), code(nullptr) {}
+};
+
+static std::unordered_map<ExprBase*, JitEntry> jit_entries;
+
+static const int64_t JIT_OK = int64_t(1) << 32;
+static const size_t JIT_LOCAL_ARGS = 4;      ///< Arguments passed without a heap buffer
+
+// A compiled call nests a few native frames, and they take more stack
+// than an interpreted call. Deep recursion runs compiled code only up to
+// JIT_MAX_NESTING levels and is interpreted below that, so it reaches
+// about the same depth as with the JIT off.
+static const unsigned JIT_MAX_NESTING = 1000;
+static unsigned jit_nesting = 0;            // Compiled calls currently running
+
+// ============================================================================
+// Runtime helpers called from compiled code
+// ============================================================================
+
+/**
+ * @brief Resolve a call site's operator, failing the way Apply::eval would
+ *
+ * Used before evaluating arguments that themselves make calls, so an invalid
+ * operator is reported before any of their side effects happen.
+ */
+static int64_t jitCheckRator(JitFrame *frame, int64_t index) {
+    try {
+        Value proc = frame->code->sites[index].node->rator->eval(*frame->env);
+        if (proc.get() == nullptr) throw RuntimeError("Unbound variable");
+        if (proc->v_type != V_PROC) throw RuntimeError("Attempt to apply a non-procedure");
+        return JIT_OK;
+    } catch (...) {
+        frame->error = std::current_exception();
+        return 0;
+    }
+}
+
+/**
+ * @brief Box the pushed arguments, apply the operator and unbox the result
+ */
+static int64_t jitApply(JitFrame *frame, int64_t index, const int64_t *stack) {
+    try {
+        JitSite &site = frame->code->sites[index];
+        size_t n = site.bool_args.size();
+        std::vector<Value> args;
+        args.reserve(n);
+        for (size_t k = 0; k < n; ++k) {
+            int32_t raw = (int32_t)stack[n - 1 - k];
+            args.push_back(site.bool_args[k] ? BooleanV(raw != 0) : IntegerV(raw));
+        }
+        Value proc = site.node->rator->eval(*frame->env);
+        if (proc.get() == nullptr) throw RuntimeError("Unbound variable");
+        // As applyProcedure, one native frame shallower
+        if (proc->v_type != V_PROC) throw RuntimeError("Attempt to apply a non-procedure");
+        Procedure *callee = static_cast<Procedure*>(proc.get());
+        if (n != callee->code->arity) throw RuntimeError("Wrong number of arguments");
+        Value result = applyClosure(callee, args);
+        if (frame->results.empty()) frame->results.resize(frame->code->sites.size(), Value(nullptr));
+        frame->results[index] = result;
+        if (result->v_type != V_INT) return 0;
+        return JIT_OK | (uint32_t)static_cast<Integer*>(result.get())->n;
+    } catch (...) {
+        frame->error = std::current_exception();
+        return 0;
+    }
+}
+
+// ============================================================================
+// Code generation
+// ============================================================================
+
+/**
+ * @brief Byte buffer with rel32 label patching
+ */
+struct Assembler {
+    std::vector<uint8_t> buf;
+
+    void emit(std::initializer_list<uint8_t> bytes) {
+        buf.insert(buf.end(), bytes.begin(), bytes.end());
+    }
+    void imm32(int32_t v) {
+        for (int i = 0; i < 4; ++i) buf.push_back((uint8_t)(v >> (8 * i)));
+    }
+    void imm64(uint64_t v) {
+        for (int i = 0; i < 8; ++i) buf.push_back((uint8_t)(v >> (8 * i)));
+    }
+    // Emit a rel32 placeholder and return its offset for bind()
+    size_t label() {
+        size_t at = buf.size();
+        imm32(0);
+        return at;
+    }
+    // Point the rel32 at offset `at` to the current position
+    void bind(size_t at) {
+        int32_t rel = (int32_t)(buf.size() - (at + 4));
+        std::memcpy(&buf[at], &rel, 4);
+    }
+};
+
+class JitCompiler {
+    const std::vector<std::string> &params;
+    JitCode *code;
+    Assembler as;
+    int depth;                                  // 8-byte pushes below the frame
+    std::vector<size_t> bails;                  // Jumps to the bailout exit
+    std::unordered_map<ExprBase*, JitType> types;
+
+    int paramIndex(const std::string &x) {
+        for (int i = (int)params.size() - 1; i >= 0; --i)
+            if (params[i] == x) return i;
+        return -1;
+    }
+
+    bool hasCall(ExprBase *e) {
+        if (e->e_type == E_APPLY) return true;
+        if (e->e_type == E_LAZY_BODY) return hasCall(static_cast<LazyBody*>(e)->body.get());
+        if (Binary *b = dynamic_cast<Binary*>(e)) return hasCall(b->rand1.get()) || hasCall(b->rand2.get());
+        if (Unary *u = dynamic_cast<Unary*>(e)) return hasCall(u->rand.get());
+        if (If *i = dynamic_cast<If*>(e))
+            return hasCall(i->cond.get()) || hasCall(i->conseq.get()) || hasCall(i->alter.get());
+        if (Begin *b = dynamic_cast<Begin*>(e)) {
+            for (auto &x : b->es) if (hasCall(x.get())) return true;
+        }
+        return false;
+    }
+
+    JitType check(ExprBase *e) {
+        auto it = types.find(e);
+        if (it != types.end()) return it->second;
+        JitType t = classify(e);
+        types[e] = t;
+        return t;
+    }
+
+    JitType classify(ExprBase *e) {
+        switch (e->e_type) {
+            case E_FIXNUM:
+                return J_INT;
+            case E_TRUE:
+            case E_FALSE:
+                return J_BOOL;
+            case E_VAR:
+                return paramIndex(static_cast<Var*>(e)->x) >= 0 ? J_INT : J_NONE;
+            case E_PLUS: case E_MINUS: case E_MUL:
+            case E_LT: case E_LE: case E_EQ: case E_GE: case E_GT: {
+                Binary *b = dynamic_cast<Binary*>(e);
+                if (!b || b->watch->fired) return J_NONE;
+                if (check(b->rand1.get()) != J_INT || check(b->rand2.get()) != J_INT) return J_NONE;
+                code->watches.add(b->watch);
+                return (e->e_type == E_PLUS || e->e_type == E_MINUS || e->e_type == E_MUL) ? J_INT : J_BOOL;
+            }
+            case E_EQQ: {
+                Binary *b = static_cast<Binary*>(e);
+                if (b->watch->fired) return J_NONE;
+                JitType t = check(b->rand1.get());
+                if (t == J_NONE || t != check(b->rand2.get())) return J_NONE;
+                code->watches.add(b->watch);
+                return J_BOOL;
+            }
+            case E_NOT: {
+                Unary *u = static_cast<Unary*>(e);
+                if (u->watch->fired || check(u->rand.get()) == J_NONE) return J_NONE;
+                code->watches.add(u->watch);
+                return J_BOOL;
+            }
+            case E_IF: {
+                If *i = static_cast<If*>(e);
+                JitType c = check(i->cond.get());
+                JitType a = check(i->conseq.get());
+                if (c == J_NONE || a == J_NONE) return J_NONE;
+                if (c == J_INT) return a;
+                return check(i->alter.get()) == a ? a : J_NONE;
+            }
+            case E_BEGIN: {
+                Begin *b = static_cast<Begin*>(e);
+                if (b->es.empty()) return J_NONE;
+                JitType t = J_NONE;
+                for (auto &x : b->es) {
+                    t = check(x.get());
+                    if (t == J_NONE) return J_NONE;
+                }
+                return t;
+            }
+            case E_UNBOXED_ARITH:
+            case E_UNBOXED_TEST:
+                return check(static_cast<UnboxedFixnum*>(e)->generic.get());
+            case E_LAZY_BODY: {
+                // Parsed by the first call, long before the body is hot
+                LazyBody *l = static_cast<LazyBody*>(e);
+                return l->body.get() == nullptr ? J_NONE : check(l->body.get());
+            }
+            case E_APPLY: {
+                Apply *a = static_cast<Apply*>(e);
+                Var *rator = dynamic_cast<Var*>(a->rator.get());
+                if (a->rator->e_type != E_CONSTANT && (!rator || paramIndex(rator->x) >= 0)) return J_NONE;
+                for (auto &x : a->rand)
+                    if (check(x.get()) == J_NONE) return J_NONE;
+                return J_INT;
+            }
+            default:
+                return J_NONE;
+        }
+    }
+
+    void emitCall(void *helper) {
+        bool pad = depth % 2 != 0;
+        if (pad) as.emit({0x48, 0x83, 0xEC, 0x08});            // sub rsp, 8
+        as.emit({0x48, 0xB8});                                 // mov rax, helper
+        as.imm64((uint64_t)helper);
+        as.emit({0xFF, 0xD0});                                 // call rax
+        if (pad) as.emit({0x48, 0x83, 0xC4, 0x08});            // add rsp, 8
+        as.emit({0x48, 0x89, 0xC1,                             // mov rcx, rax
+                 0x48, 0xC1, 0xE9, 0x20,                       // shr rcx, 32
+                 0x85, 0xC9,                                   // test ecx, ecx
+                 0x0F, 0x84});                                 // jz bail
+        bails.push_back(as.label());
+        as.emit({0x89, 0xC0});                                 // mov eax, eax
+    }
+
+    void emit(ExprBase *e) {
+        switch (e->e_type) {
+            case E_FIXNUM:
+                as.emit({0xB8});                               // mov eax, n
+                as.imm32(static_cast<Fixnum*>(e)->n);
+                return;
+            case E_TRUE:
+            case E_FALSE:
+                as.emit({0xB8});
+                as.imm32(e->e_type == E_TRUE ? 1 : 0);
+                return;
+            case E_VAR:
+                as.emit({0x8B, 0x83});                         // mov eax, [rbx + 8*i]
+                as.imm32(8 * paramIndex(static_cast<Var*>(e)->x));
+                return;
+            case E_PLUS: case E_MINUS: case E_MUL:
+            case E_LT: case E_LE: case E_EQ: case E_GE: case E_GT: case E_EQQ: {
+                Binary *b = static_cast<Binary*>(e);
+                emit(b->rand2.get());
+                as.emit({0x50});                               // push rax
+                ++depth;
+                emit(b->rand1.get());
+                as.emit({0x59});                               // pop rcx
+                --depth;
+                switch (e->e_type) {
+                    case E_PLUS:  as.emit({0x01, 0xC8}); return;          // add eax, ecx
+                    case E_MINUS: as.emit({0x29, 0xC8}); return;          // sub eax, ecx
+                    case E_MUL:   as.emit({0x0F, 0xAF, 0xC1}); return;    // imul eax, ecx
+                    default: break;
+                }
+                uint8_t cc = 0x94;                                        // sete
+                if (e->e_type == E_LT) cc = 0x9C;                         // setl
+                else if (e->e_type == E_LE) cc = 0x9E;                    // setle
+                else if (e->e_type == E_GE) cc = 0x9D;                    // setge
+                else if (e->e_type == E_GT) cc = 0x9F;                    // setg
+                as.emit({0x39, 0xC8, 0x0F, cc, 0xC0,                      // cmp eax, ecx; setcc al
+                         0x0F, 0xB6, 0xC0});                              // movzx eax, al
+                return;
+            }
+            case E_NOT: {
+                ExprBase *rand = static_cast<Unary*>(e)->rand.get();
+                emit(rand);
+                if (check(rand) == J_BOOL) as.emit({0x83, 0xF0, 0x01});  // xor eax, 1
+                else as.emit({0x31, 0xC0});                               // xor eax, eax
+                return;
+            }
+            case E_IF: {
+                If *i = static_cast<If*>(e);
+                emit(i->cond.get());
+                if (check(i->cond.get()) == J_INT) {
+                    // A fixnum is always true
+                    emit(i->conseq.get());
+                    return;
+                }
+                as.emit({0x85, 0xC0, 0x0F, 0x84});             // test eax, eax; jz else
+                size_t to_else = as.label();
+                emit(i->conseq.get());
+                as.emit({0xE9});                               // jmp end
+                size_t to_end = as.label();
+                as.bind(to_else);
+                emit(i->alter.get());
+                as.bind(to_end);
+                return;
+            }
+            case E_BEGIN:
+                for (auto &x : static_cast<Begin*>(e)->es) emit(x.get());
+                return;
+            case E_UNBOXED_ARITH:
+            case E_UNBOXED_TEST:
+                emit(static_cast<UnboxedFixnum*>(e)->generic.get());
+                return;
+            case E_LAZY_BODY:
+                emit(static_cast<LazyBody*>(e)->body.get());
+                return;
+            case E_APPLY: {
+                Apply *a = static_cast<Apply*>(e);
+                int32_t index = (int32_t)code->sites.size();
+                JitSite site;
+                site.node = a;
+                for (auto &x : a->rand) site.bool_args.push_back(check(x.get()) == J_BOOL);
+                code->sites.push_back(site);
+
+                bool nested = false;
+                for (auto &x : a->rand) nested = nested || hasCall(x.get());
+                if (nested) {
+                    as.emit({0x4C, 0x89, 0xE7, 0xBE});         // mov rdi, r12; mov esi, index
+                    as.imm32(index);
+                    emitCall((void *)&jitCheckRator);
+                }
+                for (auto &x : a->rand) {
+                    emit(x.get());
+                    as.emit({0x50});                           // push rax
+                    ++depth;
+                }
+                as.emit({0x48, 0x89, 0xE2,                     // mov rdx, rsp
+                         0x4C, 0x89, 0xE7, 0xBE});             // mov rdi, r12; mov esi, index
+                as.imm32(index);
+                emitCall((void *)&jitApply);
+                // emitCall ends with eax live; dropping the arguments keeps it
+                if (!a->rand.empty()) {
+                    as.emit({0x48, 0x8D, 0xA4, 0x24});         // lea rsp, [rsp + 8*n]
+                    as.imm32(8 * (int32_t)a->rand.size());
+                    depth -= (int)a->rand.size();
+                }
+                return;
+            }
+            default:
+                return;
+        }
+    }
+
+public:
+    JitCompiler(const std::vector<std::string> &ps) : params(ps), code(nullptr), depth(0) {}
+
+    JitCode *compile(ExprBase *body) {
+        code = new JitCode();
+        JitType result = check(body);
+        if (result == J_NONE) {
+            delete code;
+            return nullptr;
+        }
+        code->result = result;
+
+        as.emit({0x55,                                         // push rbp
+                 0x48, 0x89, 0xE5,                             // mov rbp, rsp
+                 0x53,                                         // push rbx
+                 0x41, 0x54,                                   // push r12
+                 0x48, 0x89, 0xFB,                             // mov rbx, rdi
+                 0x49, 0x89, 0xF4});                           // mov r12, rsi
+        emit(body);
+        as.emit({0x48, 0xBA});                                 // mov rdx, 1 << 32
+        as.imm64((uint64_t)JIT_OK);
+        as.emit({0x48, 0x09, 0xD0,                             // or rax, rdx
+                 0x41, 0x5C, 0x5B, 0x5D, 0xC3});               // pop r12; pop rbx; pop rbp; ret
+        for (size_t at : bails) as.bind(at);
+        as.emit({0x48, 0x8D, 0x65, 0xF0,                       // lea rsp, [rbp - 16]
+                 0x31, 0xC0,                                   // xor eax, eax
+                 0x41, 0x5C, 0x5B, 0x5D, 0xC3});               // pop r12; pop rbx; pop rbp; ret
+
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        size_t len = (as.buf.size() + page - 1) / page * page;
+        void *mem = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) {
+            delete code;
+            return nullptr;
+        }
+        std::memcpy(mem, as.buf.data(), as.buf.size());
+        if (mprotect(mem, len, PROT_READ | PROT_EXEC) != 0) {
+            munmap(mem, len);
+            delete code;
+            return nullptr;
+        }
+        code->fn = (JitFn)mem;
+        code->length = len;
+        perfMap(mem, as.buf.size(), body);
+        return code;
+    }
+
+    void perfMap(void *addr, size_t size, ExprBase *body) {
+        static FILE *map = nullptr;
+        if (map == nullptr) {
+            char path[64];
+            std::snprintf(path, sizeof(path), "/tmp/perf-%d.map", (int)getpid());
+            map = std::fopen(path, "a");
+            if (map == nullptr) return;
+        }
+        std::string name = "scheme_lambda_";
+        for (size_t i = 0; i < params.size(); ++i) name += (i ? "_" : "") + params[i];
+        std::fprintf(map, "%lx %zx %s@%p\n", (unsigned long)addr, size, name.c_str(), (void *)body);
+        std::fflush(map);
+    }
+};
+
+// The compile and bailout paths are kept out of jitCall so that its frame,
+// which every compiled call nests on the native stack, stays small.
+
+/**
+ * @brief Count a call of an uncompiled body and compile it once it is hot
+ */
+static __attribute__((noinline)) bool jitCompileHot(Procedure *proc, JitEntry &entry) {
+    if (entry.tried || ++entry.calls < jit_threshold) return false;
+    entry.tried = true;
+    entry.code = JitCompiler(proc->code->parameters).compile(proc->code->body.get());
+    return entry.code != nullptr;
+}
+
+/**
+ * @brief Finish a call whose compiled code bailed out
+ */
+static __attribute__((noinline)) void jitBailout(Procedure *proc, const std::vector<Value> &args,
+                                                 JitFrame &frame, Value &result) {
+    if (frame.error) std::rethrow_exception(frame.error);
+
+    // A call returned a non-fixnum: re-evaluate the body in the interpreter,
+    // reusing the results of the calls already made.
+    Assoc call_env = proc->env;
+    for (size_t i = 0; i < proc->code->arity; ++i) {
+        call_env = extend(proc->code->parameters[i], args[i], call_env);
+    }
+    JitReplay replay;
+    replay.env = call_env.get();
+    replay.prev = jit_replay;
+    for (size_t i = 0; i < frame.results.size(); ++i) {
+        if (frame.results[i].get() != nullptr)
+            replay.results.insert(std::make_pair(frame.code->sites[i].node, frame.results[i]));
+    }
+    jit_replay = &replay;
+    try {
+        result = proc->code->body->eval(call_env);
+    } catch (...) {
+        jit_replay = replay.prev;
+        throw;
+    }
+    jit_replay = replay.prev;
+}
+
+bool jitCall(Procedure *proc, const std::vector<Value> &args, Value &result) {
+    if (!jit_enabled) return false;
+    JitEntry &entry = jit_entries[proc->code->body.get()];
+    if (entry.code != nullptr && entry.code->watches.fired()) {
+        // A primitive compiled inline was redefined: interpret from now on.
+        // The code may still be running further up the stack, so it is kept.
+        entry.code = nullptr;
+    }
+    if (entry.code == nullptr && !jitCompileHot(proc, entry)) return false;
+    if (jit_nesting >= JIT_MAX_NESTING) return false;
+    JitCode *code = entry.code;
+
+    // Entry guard: every argument must be a fixnum
+    int64_t local[JIT_LOCAL_ARGS];
+    std::vector<int64_t> spill;
+    int64_t *raw = local;
+    if (args.size() > JIT_LOCAL_ARGS) {
+        spill.resize(args.size());
+        raw = spill.data();
+    }
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i]->v_type != V_INT) return false;
+        raw[i] = static_cast<Integer*>(args[i].get())->n;
+    }
+
+    JitFrame frame(code, &proc->env);
+    ++jit_nesting;
+    int64_t r = code->fn(raw, &frame);      // Never throws: helpers catch everything
+    --jit_nesting;
+    if (r != 0) {
+        int32_t n = (int32_t)r;
+        result = code->result == J_BOOL ? BooleanV(n != 0) : IntegerV(n);
+        return true;
+    }
+    jitBailout(proc, args, frame, result);
+    return true;
+}
+
+void jitForget(ExprBase *body) {
+    auto it = jit_entries.find(body);
+    if (it == jit_entries.end()) return;
+    // No procedure with this body is left, so its code cannot be running
+    JitCode *code = it->second.code;
+    if (code != nullptr) {
+        munmap((void *)code->fn, code->length);
+        delete code;
+    }
+    jit_entries.erase(it);
+}
+
+#else
+
+bool jitCall(Procedure *proc, const std::vector<Value> &args, Value &result) {
+    return false;
+}
+
+void jitForget(ExprBase *body) {}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef JIT_HPP
+#define JIT_HPP
+
+/**
+ * @file jit.hpp
+ * @brief Baseline template JIT for hot fixnum procedures (x86-64 Linux)
+ *
+ * Once a procedure body has been applied jit_threshold times it is compiled
+ * to machine code, provided the body only uses fixnum literals, parameters,
+ * binary + - *, comparisons, eq?, not, if, begin and calls through global
+ * variables. Calls go back into the runtime; everything else stays
+ * interpreted.
+ *
+ * Guards:
+ *  - every argument must be a fixnum on entry, or the call is interpreted;
+ *  - a call from compiled code must return a fixnum. If it does not, the
+ *    compiled code bails out and the interpreter re-evaluates the body,
+ *    replaying the results of calls already made instead of repeating
+ *    them. Everything else in a compiled body is pure, so the replay
+ *    reaches the same state and the output matches the interpreter;
+ *  - once a primitive compiled inline is redefined (see PrimitiveWatch),
+ *    the body is interpreted from its next call on.
+ *
+ * Compiled code is registered in /tmp/perf-<pid>.map for perf.
+ */
+
+#include "Def.hpp"
+#include "value.hpp"
+#include <vector>
+
+struct Apply;
+struct JitReplay;
+
+extern bool jit_enabled;          ///< Compile hot procedures (default on where supported)
+extern unsigned jit_threshold;    ///< Applications before a body is compiled
+extern JitReplay *jit_replay;     ///< Innermost body being replayed after a bailout
+
+/**
+ * @brief Run a procedure through compiled code if it is (or becomes) hot
+ * @return true if the call was handled and result was set
+ */
+bool jitCall(Procedure *, const std::vector<Value> &, Value &);
+
+/**
+ * @brief Drop the call count and compiled code of a body about to be destroyed
+ */
+void jitForget(ExprBase *);
+
+/**
+ * @brief During a replay, fetch the recorded result of a call site
+ * @return true if the result was recorded and stored into result
+ */
+bool jitReplayed(Apply *, Assoc &, Value &);
+
+#endif // JIT_HPP
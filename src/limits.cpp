@@ -0,0 +1,17 @@
+/**
+ * @file limits.cpp
+ * @brief Storage and checks for evaluation resource limits
+ */
+
+#include "limits.hpp"
+#include "RE.hpp"
+
+long eval_fuel = -1;
+size_t heap_live = 0;
+size_t heap_limit = 0;
+
+void consumeFuel() {
+    if (eval_fuel < 0) return;
+    if (eval_fuel == 0) throw RuntimeError("Out of fuel");
+    --eval_fuel;
+}
@@ -0,0 +1,24 @@
+#ifndef LIMITS_HPP
+#define LIMITS_HPP
+
+/**
+ * @file limits.hpp
+ * @brief Resource limits applied while evaluating a request
+ *
+ * Fuel bounds the number of procedure applications and the heap limit bounds
+ * the number of live values. Both are disabled by default and are armed by
+ * the server before each request.
+ */
+
+#include <cstddef>
+
+extern long eval_fuel;       ///< Remaining procedure applications, negative if unlimited
+extern size_t heap_live;     ///< Number of live ValueBase objects
+extern size_t heap_limit;    ///< Maximum number of live values, 0 if unlimited
+
+/**
+ * @brief Consume one unit of fuel, throwing RuntimeError when exhausted
+ */
+void consumeFuel();
+
+#endif // LIMITS_HPP
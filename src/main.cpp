@@ -3,9 +3,16 @@
 #include "expr.hpp"
 #include "value.hpp"
 #include "RE.hpp"
+#include "server.hpp"
+#include "jit.hpp"
+#include "pool.hpp"
+#include "optimize.hpp"
+#include "stats.hpp"
+#include "batch.hpp"
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <cstdlib>
 
 extern std::map<std::string, ExprType> primitives;
 extern std::map<std::string, ExprType> reserved_words;
@@ -45,6 +52,10 @@ bool isExplicitVoidCall(Expr expr) {
     return false;
 }
 
+bool use_regions = false;   // allocate each form's values in a region
+bool show_stats = false;    // print interpreter counters on exit
+bool batch_mode = false;    // read the whole program before evaluating it
+
 void REPL(){
     // read - evaluation - print loop
     Assoc global_env = empty();
@@ -55,22 +66,85 @@ void REPL(){
         Syntax stx = readSyntax(std :: cin); // read
         try{
             Expr expr = stx -> parse(global_env); // parse
+            optimize(expr, global_env);
+            // Only evaluation is scoped to the region: the code may outlive the form
+            if (use_regions) regionBegin();
             // stx -> show(std :: cout); // syntax print
             Value val = expr -> eval(global_env);
-            if (val -> v_type == V_TERMINATE)
+            if (val -> v_type == V_TERMINATE) {
+                skipTeardown();
                 break;
+            }
             val -> show(std :: cout); // value print
         }
         catch (const RuntimeError &RE){
             // std :: cout << RE.message();
             std :: cout << "RuntimeError";
         }
+        if (use_regions) regionEnd();
         puts("");
+        if (release_batch != 0) {
+            // The form's output is out; finish the releases it deferred
+            std::cout.flush();
+            fflush(stdout);
+            drainReleases(0);
+        }
     }
 }
 
 
+/**
+ * Command line:
+ *   code                                  interactive REPL on stdin
+ *   code --server PATH [--prelude FILE] [--fuel N] [--heap N]
+ *                                         evaluation server on a Unix socket
+ *   code --fork-server PATH [...]         same, forking a child per request
+ *   --no-jit                              never compile hot procedures
+ *   --regions                             allocate each REPL form's values in a region
+ *   --stats                               print interpreter counters to stderr on exit
+ *   --batch                               read all of stdin first and evaluate it as one program
+ *   --unsafe                              build check-free nodes for all code (see unsafe_mode)
+ *   --release-batch N                     destroy at most N released objects at a time,
+ *                                         finishing between forms
+ */
 int main(int argc, char *argv[]) {
-    REPL();
+    std::string socket_path;
+    bool fork_server = false;
+    ServerOptions opts;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 < argc && arg == "--server") {
+            socket_path = argv[++i];
+        } else if (i + 1 < argc && arg == "--fork-server") {
+            socket_path = argv[++i];
+            fork_server = true;
+        } else if (i + 1 < argc && arg == "--prelude") {
+            opts.prelude = argv[++i];
+        } else if (i + 1 < argc && arg == "--fuel") {
+            opts.fuel = std::atol(argv[++i]);
+        } else if (i + 1 < argc && arg == "--heap") {
+            opts.heap = std::strtoul(argv[++i], nullptr, 10);
+        } else if (i + 1 < argc && arg == "--release-batch") {
+            release_batch = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--unsafe") {
+            unsafe_mode = true;
+        } else if (arg == "--no-jit") {
+            jit_enabled = false;
+        } else if (arg == "--regions") {
+            use_regions = true;
+        } else if (arg == "--stats") {
+            show_stats = true;
+        } else if (arg == "--batch") {
+            batch_mode = true;
+        } else {
+            std::cerr << "unknown option " << arg << std::endl;
+            return 2;
+        }
+    }
+    if (!socket_path.empty())
+        return fork_server ? runForkServer(socket_path, opts) : runServer(socket_path, opts);
+    if (batch_mode) runBatch(std::cin, use_regions);
+    else REPL();
+    if (show_stats) printStats(std::cerr);
     return 0;
 }
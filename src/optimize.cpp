@@ -0,0 +1,1071 @@
+/**
+ * @file optimize.cpp
+ * @brief Passes over parsed top-level forms
+ */
+
+#include "optimize.hpp"
+#include <map>
+#include <set>
+#include <string>
+
+// ============================================================================
+// Tree traversal
+// ============================================================================
+
+/**
+ * @brief Calls f on each direct subexpression of e, in evaluation order
+ * where it matters; binding scopes are left to the caller
+ */
+template <typename F>
+static void forEachChild(ExprBase *e, F f) {
+    if (Unary *u = dynamic_cast<Unary*>(e)) { f(u->rand); return; }
+    if (Binary *b = dynamic_cast<Binary*>(e)) { f(b->rand1); f(b->rand2); return; }
+    if (Variadic *v = dynamic_cast<Variadic*>(e)) { for (auto &x : v->rands) f(x); return; }
+    switch (e->e_type) {
+        case E_AND: for (auto &x : static_cast<AndVar*>(e)->rands) f(x); return;
+        case E_OR: for (auto &x : static_cast<OrVar*>(e)->rands) f(x); return;
+        case E_BEGIN: for (auto &x : static_cast<Begin*>(e)->es) f(x); return;
+        case E_IF: {
+            If *i = static_cast<If*>(e);
+            f(i->cond); f(i->conseq); f(i->alter);
+            return;
+        }
+        case E_COND:
+            for (auto &clause : static_cast<Cond*>(e)->clauses) for (auto &x : clause) f(x);
+            return;
+        case E_CASE: {
+            Case *c = static_cast<Case*>(e);
+            f(c->key);
+            for (auto &x : c->bodies) f(x);
+            return;
+        }
+        case E_APPLY: {
+            Apply *a = static_cast<Apply*>(e);
+            f(a->rator);
+            for (auto &x : a->rand) f(x);
+            return;
+        }
+        case E_LAMBDA: f(static_cast<Lambda*>(e)->e); return;
+        case E_DEFINE: f(static_cast<Define*>(e)->e); return;
+        case E_SET: f(static_cast<Set*>(e)->e); return;
+        case E_MAKE_BOX: f(static_cast<MakeBox*>(e)->e); return;
+        case E_BOX_SET: f(static_cast<BoxSet*>(e)->e); return;
+        case E_LIST_PIPELINE: {
+            // The operands are shared with the original calls, which are not visited
+            ListPipeline *l = static_cast<ListPipeline*>(e);
+            if (l->kons.get() != nullptr) { f(l->kons); f(l->knil); }
+            f(l->source);
+            for (auto &stage : l->stages) f(stage.second);
+            return;
+        }
+        case E_ROLLBACK: f(static_cast<Rollback*>(e)->id); return;
+        case E_LET: {
+            Let *l = static_cast<Let*>(e);
+            for (auto &b : l->bind) f(b.second);
+            f(l->body);
+            return;
+        }
+        case E_LETREC: {
+            Letrec *l = static_cast<Letrec*>(e);
+            for (auto &b : l->bind) f(b.second);
+            f(l->body);
+            return;
+        }
+        case E_GUARD: {
+            Guard *g = static_cast<Guard*>(e);
+            f(g->body);
+            for (auto &clause : g->clauses) {
+                f(clause.first);
+                if (clause.second.get() != nullptr) f(clause.second);
+            }
+            return;
+        }
+        default:
+            return;
+    }
+}
+
+static void collectAssigned(ExprBase *e, std::set<std::string> &out) {
+    if (e->e_type == E_SET) out.insert(static_cast<Set*>(e)->var);
+    forEachChild(e, [&out](Expr &c) { collectAssigned(c.get(), out); });
+}
+
+// Targets of set! and define
+static void collectMutated(ExprBase *e, std::set<std::string> &out) {
+    if (e->e_type == E_SET) out.insert(static_cast<Set*>(e)->var);
+    if (e->e_type == E_DEFINE) out.insert(static_cast<Define*>(e)->var);
+    forEachChild(e, [&out](Expr &c) { collectMutated(c.get(), out); });
+}
+
+// ============================================================================
+// Binding analysis
+// ============================================================================
+
+/**
+ * @brief True if evaluating e can extend or replace the environment it runs in
+ *
+ * Only expressions evaluated in the same environment count: lambda, let and
+ * letrec bodies and guard clauses run in environments of their own.
+ */
+static bool extendsScope(ExprBase *e) {
+    switch (e->e_type) {
+        case E_DEFINE:
+        case E_ROLLBACK:
+            return true;
+        case E_LAMBDA:
+        case E_LETREC:
+            return false;
+        case E_LET:
+            for (auto &b : static_cast<Let*>(e)->bind)
+                if (extendsScope(b.second.get())) return true;
+            return false;
+        case E_GUARD:
+            return extendsScope(static_cast<Guard*>(e)->body.get());
+        default: {
+            bool found = false;
+            forEachChild(e, [&found](Expr &c) { found = found || extendsScope(c.get()); });
+            return found;
+        }
+    }
+}
+
+/**
+ * @brief Bindings one construct adds, in the order they are extended
+ */
+struct Scope {
+    std::vector<std::string> names;
+    std::vector<Lambda*> callees;   ///< Known callee per name, or null
+    bool dynamic;                   ///< Body may add bindings at run time
+};
+
+class BindingAnalysis {
+    std::vector<Scope> scopes;
+    std::set<std::string> assigned;
+    Assoc &env;
+
+    void push(const std::vector<std::string> &names, bool dynamic) {
+        scopes.push_back(Scope());
+        scopes.back().names = names;
+        scopes.back().callees.assign(names.size(), nullptr);
+        scopes.back().dynamic = dynamic;
+    }
+
+    void resolve(Apply *call, const std::string &name) {
+        size_t hops = 0;
+        for (size_t k = scopes.size(); k-- > 0; ) {
+            Scope &scope = scopes[k];
+            if (scope.dynamic) return;
+            // The last binding of a name is the one nearest the environment head
+            for (size_t i = scope.names.size(); i-- > 0; ) {
+                if (scope.names[i] != name) continue;
+                Lambda *callee = scope.callees[i];
+                if (callee != nullptr && callee->x.size() == call->rand.size()) {
+                    call->known = callee;
+                    call->known_hops = hops + scope.names.size() - 1 - i;
+                }
+                return;
+            }
+            hops += scope.names.size();
+        }
+        for (Assoc i = env; i.get() != nullptr; i = i->next) {
+            if (i->x == name) {
+                call->global = i.ptr;
+                call->global_epoch = env_epoch;
+                return;
+            }
+        }
+    }
+
+    void walk(ExprBase *e) {
+        switch (e->e_type) {
+            case E_APPLY: {
+                Apply *a = static_cast<Apply*>(e);
+                if (a->rator->e_type == E_VAR) resolve(a, static_cast<Var*>(a->rator.get())->x);
+                break;
+            }
+            case E_LAMBDA: {
+                Lambda *l = static_cast<Lambda*>(e);
+                push(l->x, extendsScope(l->e.get()));
+                walk(l->e.get());
+                scopes.pop_back();
+                return;
+            }
+            case E_LET: {
+                Let *l = static_cast<Let*>(e);
+                std::vector<std::string> names;
+                for (auto &b : l->bind) {
+                    walk(b.second.get());
+                    names.push_back(b.first);
+                }
+                push(names, extendsScope(l->body.get()));
+                walk(l->body.get());
+                scopes.pop_back();
+                return;
+            }
+            case E_LETREC: {
+                Letrec *l = static_cast<Letrec*>(e);
+                std::vector<std::string> names;
+                bool dynamic = extendsScope(l->body.get());
+                for (auto &b : l->bind) {
+                    names.push_back(b.first);
+                    dynamic = dynamic || extendsScope(b.second.get());
+                }
+                push(names, dynamic);
+                for (size_t i = 0; i < l->bind.size(); ++i) {
+                    ExprBase *init = l->bind[i].second.get();
+                    if (init->e_type == E_LAMBDA && assigned.count(l->bind[i].first) == 0)
+                        scopes.back().callees[i] = static_cast<Lambda*>(init);
+                }
+                for (auto &b : l->bind) walk(b.second.get());
+                walk(l->body.get());
+                scopes.pop_back();
+                return;
+            }
+            case E_GUARD: {
+                Guard *g = static_cast<Guard*>(e);
+                walk(g->body.get());
+                bool dynamic = false;
+                for (auto &clause : g->clauses) {
+                    dynamic = dynamic || extendsScope(clause.first.get());
+                    if (clause.second.get() != nullptr)
+                        dynamic = dynamic || extendsScope(clause.second.get());
+                }
+                push(std::vector<std::string>(1, g->var), dynamic);
+                for (auto &clause : g->clauses) {
+                    walk(clause.first.get());
+                    if (clause.second.get() != nullptr) walk(clause.second.get());
+                }
+                scopes.pop_back();
+                return;
+            }
+            default:
+                break;
+        }
+        forEachChild(e, [this](Expr &c) { walk(c.get()); });
+    }
+
+public:
+    BindingAnalysis(const Expr &form, Assoc &env) : env(env) {
+        collectAssigned(form.get(), assigned);
+    }
+
+    void run(const Expr &form) {
+        walk(form.get());
+    }
+};
+
+void analyzeBindings(const Expr &form, Assoc &env) {
+    BindingAnalysis analysis(form, env);
+    analysis.run(form);
+}
+
+// ============================================================================
+// Assignment conversion
+// ============================================================================
+
+class AssignmentConversion {
+    struct Binding {
+        std::string name;
+        bool convertible;       ///< Every reference reaches it statically, no define replaces it
+        bool assigned;
+        Expr *init;             ///< let or letrec initializer, or null for a parameter
+        Lambda *lambda;         ///< Parameter: the lambda it belongs to
+    };
+
+    struct Frame {
+        std::vector<int> ids;
+        bool dynamic;
+    };
+
+    /**
+     * @brief A Var or Set node and the binding it refers to
+     */
+    struct Use {
+        Expr *slot;
+        int binding;
+    };
+
+    std::vector<Binding> bindings;
+    std::vector<Frame> frames;
+    std::vector<Use> uses;      // Inner nodes come before the Set nodes holding them
+
+    void push(const std::vector<std::string> &names, bool dynamic, Lambda *lambda) {
+        Frame f;
+        f.dynamic = dynamic;
+        for (auto &name : names) {
+            Binding b;
+            b.name = name;
+            b.convertible = !dynamic;
+            b.assigned = false;
+            b.init = nullptr;
+            b.lambda = lambda;
+            bindings.push_back(b);
+            f.ids.push_back((int)bindings.size() - 1);
+        }
+        frames.push_back(f);
+    }
+
+    void use(const std::string &name, Expr &slot, bool assign) {
+        bool dynamic = false;
+        for (size_t k = frames.size(); k-- > 0; ) {
+            for (size_t i = frames[k].ids.size(); i-- > 0; ) {
+                int id = frames[k].ids[i];
+                if (bindings[id].name != name) continue;
+                // A define in a scope in between could shadow it at run time
+                if (dynamic) bindings[id].convertible = false;
+                bindings[id].assigned = bindings[id].assigned || assign;
+                uses.push_back(Use{&slot, id});
+                return;
+            }
+            dynamic = dynamic || frames[k].dynamic;
+        }
+    }
+
+    void walk(Expr &slot) {
+        ExprBase *e = slot.get();
+        switch (e->e_type) {
+            case E_VAR:
+                use(static_cast<Var*>(e)->x, slot, false);
+                return;
+            case E_SET:
+                walk(static_cast<Set*>(e)->e);
+                use(static_cast<Set*>(e)->var, slot, true);
+                return;
+            case E_LAMBDA: {
+                Lambda *l = static_cast<Lambda*>(e);
+                push(l->x, extendsScope(l->e.get()), l);
+                walk(l->e);
+                frames.pop_back();
+                return;
+            }
+            case E_LET: {
+                Let *l = static_cast<Let*>(e);
+                std::vector<std::string> names;
+                for (auto &b : l->bind) {
+                    walk(b.second);
+                    names.push_back(b.first);
+                }
+                push(names, extendsScope(l->body.get()), nullptr);
+                for (size_t i = 0; i < l->bind.size(); ++i)
+                    bindings[frames.back().ids[i]].init = &l->bind[i].second;
+                walk(l->body);
+                frames.pop_back();
+                return;
+            }
+            case E_LETREC: {
+                Letrec *l = static_cast<Letrec*>(e);
+                std::vector<std::string> names;
+                bool dynamic = extendsScope(l->body.get());
+                for (auto &b : l->bind) {
+                    names.push_back(b.first);
+                    dynamic = dynamic || extendsScope(b.second.get());
+                }
+                push(names, dynamic, nullptr);
+                for (size_t i = 0; i < l->bind.size(); ++i)
+                    bindings[frames.back().ids[i]].init = &l->bind[i].second;
+                for (auto &b : l->bind) walk(b.second);
+                walk(l->body);
+                frames.pop_back();
+                return;
+            }
+            case E_GUARD: {
+                // The condition variable is left as it is
+                Guard *g = static_cast<Guard*>(e);
+                walk(g->body);
+                push(std::vector<std::string>(1, g->var), true, nullptr);
+                for (auto &clause : g->clauses) {
+                    walk(clause.first);
+                    if (clause.second.get() != nullptr) walk(clause.second);
+                }
+                frames.pop_back();
+                return;
+            }
+            default:
+                break;
+        }
+        forEachChild(e, [this](Expr &c) { walk(c); });
+    }
+
+    bool converted(int id) {
+        return bindings[id].convertible && bindings[id].assigned;
+    }
+
+public:
+    void run(Expr &form) {
+        walk(form);
+        for (const Use &u : uses) {
+            if (!converted(u.binding)) continue;
+            ExprBase *e = u.slot->get();
+            if (e->e_type == E_VAR)
+                *u.slot = Expr(new BoxRef(static_cast<Var*>(e)->x));
+            else
+                *u.slot = Expr(new BoxSet(static_cast<Set*>(e)->var, static_cast<Set*>(e)->e));
+        }
+        // Parameters are boxed on entry by a let around the body
+        std::map<Lambda*, std::vector<std::pair<std::string, Expr>>> entry;
+        std::vector<Lambda*> order;
+        for (size_t id = 0; id < bindings.size(); ++id) {
+            if (!converted((int)id)) continue;
+            Binding &b = bindings[id];
+            if (b.init != nullptr) {
+                *b.init = Expr(new MakeBox(*b.init));
+                continue;
+            }
+            if (entry.count(b.lambda) == 0) order.push_back(b.lambda);
+            entry[b.lambda].push_back(std::make_pair(b.name, Expr(new MakeBox(Expr(new Var(b.name))))));
+        }
+        for (Lambda *l : order) l->e = Expr(new Let(entry[l], l->e));
+    }
+};
+
+void convertAssignments(Expr &form) {
+    AssignmentConversion conversion;
+    conversion.run(form);
+}
+
+// ============================================================================
+// Lambda lifting
+// ============================================================================
+
+class LambdaLifting {
+    struct Binding {
+        std::string name;
+        size_t frame;       ///< Index of the frame that holds it
+        Lambda *callee;     ///< letrec: lambda initializer, if never assigned
+    };
+
+    struct Frame {
+        std::vector<int> ids;
+        bool dynamic;
+    };
+
+    /**
+     * @brief A lambda and the local variables it refers to
+     */
+    struct Candidate {
+        Lambda *lambda;
+        size_t frame_base;      ///< Frames outside the lambda
+        std::vector<size_t> sizes;  ///< Local bindings in each of those frames
+        int parent;             ///< Innermost candidate around it, or -1
+        bool liftable;          ///< No dynamic scope around it, no define inside it
+        int binding;            ///< letrec binding it initializes, or -1
+        std::set<int> free;     ///< Enclosing local bindings it refers to
+    };
+
+    /**
+     * @brief A call to a letrec-bound lambda and the bindings visible there
+     */
+    struct Call {
+        Apply *apply;
+        std::vector<int> visible;   ///< Innermost first
+        bool dynamic;               ///< A dynamic scope is in view
+    };
+
+    std::vector<Binding> bindings;
+    std::vector<Frame> frames;
+    std::vector<Candidate> candidates;
+    std::vector<size_t> open;               // Candidates being walked, innermost last
+    std::map<int, std::vector<Call>> calls;
+    std::set<int> escaped;
+    std::set<std::string> mutated;
+
+    std::vector<int> push(const std::vector<std::string> &names, bool dynamic) {
+        Frame f;
+        f.dynamic = dynamic;
+        for (auto &name : names) {
+            Binding b;
+            b.name = name;
+            b.frame = frames.size();
+            b.callee = nullptr;
+            bindings.push_back(b);
+            f.ids.push_back((int)bindings.size() - 1);
+        }
+        frames.push_back(f);
+        return f.ids;
+    }
+
+    int resolve(const std::string &name) {
+        for (size_t k = frames.size(); k-- > 0; )
+            for (size_t i = frames[k].ids.size(); i-- > 0; )
+                if (bindings[frames[k].ids[i]].name == name) return frames[k].ids[i];
+        return -1;
+    }
+
+    void reference(const std::string &name, bool called) {
+        int id = resolve(name);
+        if (id < 0) return;
+        if (bindings[id].callee != nullptr && !called) escaped.insert(id);
+        for (size_t c : open)
+            if (bindings[id].frame < candidates[c].frame_base) candidates[c].free.insert(id);
+    }
+
+    void walk(ExprBase *e) {
+        switch (e->e_type) {
+            case E_VAR:
+                reference(static_cast<Var*>(e)->x, false);
+                return;
+            case E_BOX_REF:
+                reference(static_cast<BoxRef*>(e)->x, false);
+                return;
+            case E_SET:
+                reference(static_cast<Set*>(e)->var, false);
+                walk(static_cast<Set*>(e)->e.get());
+                return;
+            case E_BOX_SET:
+                reference(static_cast<BoxSet*>(e)->var, false);
+                walk(static_cast<BoxSet*>(e)->e.get());
+                return;
+            case E_DEFINE:
+            case E_ROLLBACK:
+                for (size_t c : open) candidates[c].liftable = false;
+                break;
+            case E_APPLY: {
+                Apply *a = static_cast<Apply*>(e);
+                if (a->rator->e_type == E_VAR) {
+                    const std::string &name = static_cast<Var*>(a->rator.get())->x;
+                    int id = resolve(name);
+                    if (id >= 0 && bindings[id].callee != nullptr) {
+                        Call call;
+                        call.apply = a;
+                        call.dynamic = false;
+                        for (size_t k = frames.size(); k-- > 0; ) {
+                            call.dynamic = call.dynamic || frames[k].dynamic;
+                            for (size_t i = frames[k].ids.size(); i-- > 0; )
+                                call.visible.push_back(frames[k].ids[i]);
+                        }
+                        calls[id].push_back(call);
+                    }
+                    reference(name, true);
+                } else {
+                    walk(a->rator.get());
+                }
+                for (auto &x : a->rand) walk(x.get());
+                return;
+            }
+            case E_LAMBDA: {
+                Lambda *l = static_cast<Lambda*>(e);
+                Candidate c;
+                c.lambda = l;
+                c.frame_base = frames.size();
+                c.parent = open.empty() ? -1 : (int)open.back();
+                c.liftable = true;
+                c.binding = -1;
+                for (auto &f : frames) {
+                    c.sizes.push_back(f.ids.size());
+                    c.liftable = c.liftable && !f.dynamic;
+                }
+                candidates.push_back(c);
+                open.push_back(candidates.size() - 1);
+                push(l->x, extendsScope(l->e.get()));
+                walk(l->e.get());
+                frames.pop_back();
+                open.pop_back();
+                return;
+            }
+            case E_LET: {
+                Let *l = static_cast<Let*>(e);
+                std::vector<std::string> names;
+                for (auto &b : l->bind) {
+                    walk(b.second.get());
+                    names.push_back(b.first);
+                }
+                push(names, extendsScope(l->body.get()));
+                walk(l->body.get());
+                frames.pop_back();
+                return;
+            }
+            case E_LETREC: {
+                Letrec *l = static_cast<Letrec*>(e);
+                std::vector<std::string> names;
+                bool dynamic = extendsScope(l->body.get());
+                for (auto &b : l->bind) {
+                    names.push_back(b.first);
+                    dynamic = dynamic || extendsScope(b.second.get());
+                }
+                std::vector<int> ids = push(names, dynamic);
+                for (size_t i = 0; i < l->bind.size(); ++i) {
+                    ExprBase *init = l->bind[i].second.get();
+                    if (init->e_type == E_LAMBDA && mutated.count(l->bind[i].first) == 0)
+                        bindings[ids[i]].callee = static_cast<Lambda*>(init);
+                }
+                for (size_t i = 0; i < l->bind.size(); ++i) {
+                    size_t before = candidates.size();
+                    walk(l->bind[i].second.get());
+                    if (bindings[ids[i]].callee != nullptr) candidates[before].binding = ids[i];
+                }
+                walk(l->body.get());
+                frames.pop_back();
+                return;
+            }
+            case E_GUARD: {
+                Guard *g = static_cast<Guard*>(e);
+                walk(g->body.get());
+                bool dynamic = false;
+                for (auto &clause : g->clauses) {
+                    dynamic = dynamic || extendsScope(clause.first.get());
+                    if (clause.second.get() != nullptr)
+                        dynamic = dynamic || extendsScope(clause.second.get());
+                }
+                push(std::vector<std::string>(1, g->var), dynamic);
+                for (auto &clause : g->clauses) {
+                    walk(clause.first.get());
+                    if (clause.second.get() != nullptr) walk(clause.second.get());
+                }
+                frames.pop_back();
+                return;
+            }
+            default:
+                break;
+        }
+        forEachChild(e, [this](Expr &c) { walk(c.get()); });
+    }
+
+    /**
+     * @brief Whether the free variables of c can become extra parameters
+     *
+     * They must never change, must not be procedures bound by letrec (which
+     * would need lifting themselves), and must be the same bindings at every
+     * call, all of which must be visible.
+     */
+    bool canPassFree(const Candidate &c) {
+        if (c.binding < 0 || escaped.count(c.binding) != 0) return false;
+        for (int id : c.free) {
+            const Binding &b = bindings[id];
+            if (mutated.count(b.name) != 0 || b.callee != nullptr) return false;
+            if (b.frame == bindings[c.binding].frame) return false;
+        }
+        for (const Call &call : calls[c.binding]) {
+            if (call.dynamic || call.apply->rand.size() != c.lambda->x.size()) return false;
+            for (int id : c.free) {
+                for (int seen : call.visible) {
+                    if (bindings[seen].name != bindings[id].name) continue;
+                    if (seen != id) return false;
+                    break;
+                }
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Local bindings a closed candidate skips to reach its globals
+     *
+     * Inside an enclosing closed lambda the environment starts afresh at
+     * that lambda's parameters, which may have gained extra ones.
+     */
+    size_t liftHops(const Candidate &c) {
+        size_t base = 0;
+        int up = c.parent;
+        while (up >= 0 && !candidates[up].lambda->closed) up = candidates[up].parent;
+        if (up >= 0) base = candidates[up].frame_base;
+        size_t hops = 0;
+        for (size_t k = base; k < c.frame_base; ++k) hops += c.sizes[k];
+        if (up >= 0) hops += candidates[up].lambda->x.size() - c.sizes[base];
+        return hops;
+    }
+
+public:
+    LambdaLifting(const Expr &form) {
+        collectMutated(form.get(), mutated);
+    }
+
+    void run(const Expr &form) {
+        walk(form.get());
+        for (Candidate &c : candidates) {
+            // Top-level lambdas already capture nothing but globals
+            if (!c.liftable || c.frame_base == 0) continue;
+            if (!c.free.empty()) {
+                if (!canPassFree(c)) continue;
+                for (int id : c.free) {
+                    const std::string &name = bindings[id].name;
+                    c.lambda->x.push_back(name);
+                    for (const Call &call : calls[c.binding])
+                        call.apply->rand.push_back(Expr(new Var(name)));
+                }
+            }
+            c.lambda->closed = true;
+            c.lambda->lift_hops = liftHops(c);
+        }
+    }
+};
+
+void liftLambdas(const Expr &form) {
+    LambdaLifting lifting(form);
+    lifting.run(form);
+}
+
+// ============================================================================
+// Fixnum inference
+// ============================================================================
+
+static bool isArithmetic(ExprType t) {
+    return t == E_PLUS || t == E_MINUS || t == E_MUL;
+}
+
+static bool isComparison(ExprType t) {
+    return t == E_LT || t == E_LE || t == E_EQ || t == E_GE || t == E_GT || t == E_EQQ;
+}
+
+class FixnumInference {
+    /**
+     * @brief A lexical binding and what is assumed about it
+     */
+    struct Binding {
+        std::string name;
+        bool fixnum;        ///< Assumed to only ever hold fixnums
+        ExprBase *init;     ///< let: initializer, evaluated once
+        Lambda *callee;     ///< letrec: lambda whose every call is visible
+    };
+
+    struct Frame {
+        std::vector<int> ids;
+        bool dynamic;
+    };
+
+    std::vector<Binding> bindings;
+    std::vector<Frame> frames;
+    std::set<std::string> mutated;
+    std::map<Var*, std::pair<int, size_t>> refs;    // Variable -> binding, depth
+    std::map<Lambda*, std::vector<int>> params;     // Lambda -> parameter bindings
+    std::vector<std::pair<Apply*, int>> calls;      // Call -> callee binding
+    std::set<int> escaped;                          // Callees used other than by calling
+
+    int bind(const std::string &name, bool fixnum, ExprBase *init) {
+        Binding b;
+        b.name = name;
+        b.fixnum = fixnum && mutated.count(name) == 0;
+        b.init = init;
+        b.callee = nullptr;
+        bindings.push_back(b);
+        return (int)bindings.size() - 1;
+    }
+
+    void push(const std::vector<int> &ids, bool dynamic) {
+        frames.push_back(Frame());
+        frames.back().ids = ids;
+        frames.back().dynamic = dynamic;
+    }
+
+    /**
+     * @brief Resolve a name to its lexical binding
+     * @param hops Set to its depth, or left alone if a dynamic scope is crossed
+     * @return The binding, or -1 for a global
+     */
+    int resolve(const std::string &name, size_t &hops, bool &exact) {
+        size_t depth = 0;
+        exact = true;
+        for (size_t k = frames.size(); k-- > 0; ) {
+            Frame &f = frames[k];
+            if (f.dynamic) exact = false;
+            for (size_t i = f.ids.size(); i-- > 0; ) {
+                if (bindings[f.ids[i]].name != name) continue;
+                hops = depth + f.ids.size() - 1 - i;
+                return f.ids[i];
+            }
+            depth += f.ids.size();
+        }
+        return -1;
+    }
+
+    void reference(Var *v, bool called) {
+        size_t hops = 0;
+        bool exact;
+        int id = resolve(v->x, hops, exact);
+        if (id < 0) return;
+        if (bindings[id].callee != nullptr && !called) escaped.insert(id);
+        if (exact) refs[v] = std::make_pair(id, hops);
+    }
+
+    void walk(ExprBase *e) {
+        switch (e->e_type) {
+            case E_VAR:
+                reference(static_cast<Var*>(e), false);
+                return;
+            case E_APPLY: {
+                Apply *a = static_cast<Apply*>(e);
+                if (a->rator->e_type == E_VAR) {
+                    Var *v = static_cast<Var*>(a->rator.get());
+                    size_t hops = 0;
+                    bool exact;
+                    int id = resolve(v->x, hops, exact);
+                    if (id >= 0 && bindings[id].callee != nullptr) calls.push_back(std::make_pair(a, id));
+                    reference(v, true);
+                } else {
+                    walk(a->rator.get());
+                }
+                for (auto &x : a->rand) walk(x.get());
+                return;
+            }
+            case E_LAMBDA: {
+                Lambda *l = static_cast<Lambda*>(e);
+                std::vector<int> ids;
+                for (auto &x : l->x) ids.push_back(bind(x, false, nullptr));
+                params[l] = ids;
+                push(ids, extendsScope(l->e.get()));
+                walk(l->e.get());
+                frames.pop_back();
+                return;
+            }
+            case E_LET: {
+                Let *l = static_cast<Let*>(e);
+                std::vector<int> ids;
+                for (auto &b : l->bind) {
+                    walk(b.second.get());
+                    ids.push_back(bind(b.first, true, b.second.get()));
+                }
+                push(ids, extendsScope(l->body.get()));
+                walk(l->body.get());
+                frames.pop_back();
+                return;
+            }
+            case E_LETREC: {
+                Letrec *l = static_cast<Letrec*>(e);
+                std::vector<int> ids;
+                bool dynamic = extendsScope(l->body.get());
+                for (auto &b : l->bind) {
+                    int id = bind(b.first, false, nullptr);
+                    if (b.second->e_type == E_LAMBDA && mutated.count(b.first) == 0)
+                        bindings[id].callee = static_cast<Lambda*>(b.second.get());
+                    ids.push_back(id);
+                    dynamic = dynamic || extendsScope(b.second.get());
+                }
+                push(ids, dynamic);
+                for (auto &b : l->bind) walk(b.second.get());
+                walk(l->body.get());
+                frames.pop_back();
+                return;
+            }
+            case E_GUARD: {
+                Guard *g = static_cast<Guard*>(e);
+                walk(g->body.get());
+                bool dynamic = false;
+                for (auto &clause : g->clauses) {
+                    dynamic = dynamic || extendsScope(clause.first.get());
+                    if (clause.second.get() != nullptr)
+                        dynamic = dynamic || extendsScope(clause.second.get());
+                }
+                push(std::vector<int>(1, bind(g->var, false, nullptr)), dynamic);
+                for (auto &clause : g->clauses) {
+                    walk(clause.first.get());
+                    if (clause.second.get() != nullptr) walk(clause.second.get());
+                }
+                frames.pop_back();
+                return;
+            }
+            default:
+                forEachChild(e, [this](Expr &c) { walk(c.get()); });
+                return;
+        }
+    }
+
+    // Under the current assumptions, e always evaluates to a fixnum
+    bool proven(ExprBase *e) {
+        switch (e->e_type) {
+            case E_FIXNUM:
+                return true;
+            case E_VAR: {
+                auto it = refs.find(static_cast<Var*>(e));
+                return it != refs.end() && bindings[it->second.first].fixnum;
+            }
+            case E_PLUS: case E_MINUS: case E_MUL: {
+                Binary *b = dynamic_cast<Binary*>(e);
+                return b != nullptr && proven(b->rand1.get()) && proven(b->rand2.get());
+            }
+            case E_IF: {
+                If *i = static_cast<If*>(e);
+                return proven(i->conseq.get()) && proven(i->alter.get());
+            }
+            default:
+                return false;
+        }
+    }
+
+    // Drop assumptions contradicted by an initializer or a call, until none are
+    void solve() {
+        for (auto &b : bindings) {
+            if (b.callee == nullptr) continue;
+            bool visible = escaped.count((int)(&b - &bindings[0])) == 0;
+            for (int p : params[b.callee])
+                bindings[p].fixnum = visible && mutated.count(bindings[p].name) == 0;
+        }
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (auto &b : bindings) {
+                if (b.fixnum && b.init != nullptr && !proven(b.init)) {
+                    b.fixnum = false;
+                    changed = true;
+                }
+            }
+            for (auto &call : calls) {
+                std::vector<int> &ps = params[bindings[call.second].callee];
+                for (size_t j = 0; j < ps.size(); ++j) {
+                    if (!bindings[ps[j]].fixnum) continue;
+                    if (j >= call.first->rand.size() || ps.size() != call.first->rand.size() ||
+                        !proven(call.first->rand[j].get())) {
+                        bindings[ps[j]].fixnum = false;
+                        changed = true;
+                    }
+                }
+            }
+        }
+    }
+
+    // Literals, proven variables and + - * over them
+    bool unboxable(ExprBase *e) {
+        if (e->e_type == E_FIXNUM || e->e_type == E_VAR) return proven(e);
+        return isArithmetic(e->e_type) && proven(e);
+    }
+
+    size_t flatten(ExprBase *e, UnboxedFixnum *u) {
+        FixnumOp op;
+        op.op = e->e_type;
+        op.n = 0;
+        op.hops = 0;
+        op.lhs = op.rhs = 0;
+        if (e->e_type == E_FIXNUM) {
+            op.n = static_cast<Fixnum*>(e)->n;
+        } else if (e->e_type == E_VAR) {
+            op.hops = refs[static_cast<Var*>(e)].second;
+        } else {
+            Binary *b = static_cast<Binary*>(e);
+            op.lhs = flatten(b->rand1.get(), u);
+            op.rhs = flatten(b->rand2.get(), u);
+        }
+        u->ops.push_back(op);
+        return u->ops.size() - 1;
+    }
+
+    // Proofs rely on what + - * compute anywhere in the form
+    void watchArithmetic(UnboxedFixnum *u) {
+        u->watches.add(primitiveWatch("+"));
+        u->watches.add(primitiveWatch("-"));
+        u->watches.add(primitiveWatch("*"));
+    }
+
+    void rewrite(Expr &slot) {
+        ExprBase *e = slot.get();
+        Binary *b = dynamic_cast<Binary*>(e);
+        if (b != nullptr && isArithmetic(e->e_type) && unboxable(e)) {
+            UnboxedFixnum *u = new UnboxedFixnum(E_UNBOXED_ARITH, slot);
+            watchArithmetic(u);
+            u->root = flatten(e, u);
+            slot = Expr(u);
+            return;
+        }
+        if (b != nullptr && isComparison(e->e_type) &&
+            unboxable(b->rand1.get()) && unboxable(b->rand2.get())) {
+            UnboxedFixnum *u = new UnboxedFixnum(E_UNBOXED_TEST, slot);
+            watchArithmetic(u);
+            u->watches.add(b->watch);
+            u->cmp = e->e_type;
+            u->lhs = flatten(b->rand1.get(), u);
+            u->rhs = flatten(b->rand2.get(), u);
+            slot = Expr(u);
+            return;
+        }
+        forEachChild(e, [this](Expr &c) { rewrite(c); });
+    }
+
+public:
+    FixnumInference(const Expr &form) {
+        collectMutated(form.get(), mutated);
+    }
+
+    void run(Expr &form) {
+        walk(form.get());
+        solve();
+        rewrite(form);
+    }
+};
+
+void inferFixnums(Expr &form) {
+    FixnumInference inference(form);
+    inference.run(form);
+}
+
+// ============================================================================
+// List fusion
+// ============================================================================
+
+// The list operand of a map, filter or fold call
+static Expr *listOperand(ExprBase *e) {
+    switch (e->e_type) {
+        case E_MAP:
+        case E_FILTER: return &static_cast<Binary*>(e)->rand2;
+        case E_FOLD: return &static_cast<Variadic*>(e)->rands[2];
+        default: return nullptr;
+    }
+}
+
+static void fuse(Expr &slot) {
+    forEachChild(slot.get(), [](Expr &c) { fuse(c); });
+    ExprBase *e = slot.get();
+    Expr *list = listOperand(e);
+    if (list == nullptr) return;
+    ExprBase *inner = list->get();
+    ListPipeline *fused = new ListPipeline(slot, Expr(nullptr));
+    Expr result(fused);
+    if (inner->e_type == E_LIST_PIPELINE && static_cast<ListPipeline*>(inner)->kons.get() == nullptr) {
+        // Extend the pipeline; the generic form nests the original calls again
+        ListPipeline *p = static_cast<ListPipeline*>(inner);
+        fused->source = p->source;
+        fused->stages = p->stages;
+        fused->watches = p->watches;
+        *list = p->generic;
+    } else if (inner->e_type == E_MAP || inner->e_type == E_FILTER) {
+        Binary *b = static_cast<Binary*>(inner);
+        fused->source = b->rand2;
+        fused->stages.push_back(std::make_pair(inner->e_type, b->rand1));
+        fused->watches.add(b->watch);
+    } else {
+        return;
+    }
+    if (e->e_type == E_FOLD) {
+        fused->kons = static_cast<Variadic*>(e)->rands[0];
+        fused->knil = static_cast<Variadic*>(e)->rands[1];
+        fused->watches.add(static_cast<Variadic*>(e)->watch);
+    } else {
+        fused->stages.push_back(std::make_pair(e->e_type, static_cast<Binary*>(e)->rand1));
+        fused->watches.add(static_cast<Binary*>(e)->watch);
+    }
+    slot = result;
+}
+
+void fuseListPipelines(Expr &form) {
+    fuse(form);
+}
+
+// ============================================================================
+// Global substitution
+// ============================================================================
+
+static void substitute(Expr &slot, const std::map<std::string, Value> &known) {
+    if (slot->e_type != E_VAR) {
+        forEachChild(slot.get(), [&known](Expr &c) { substitute(c, known); });
+        return;
+    }
+    auto it = known.find(static_cast<Var*>(slot.get())->x);
+    if (it == known.end()) return;
+    const Value &v = it->second;
+    // Literals stay visible to fixnum inference and the JIT
+    if (v->v_type == V_INT) slot = Expr(new Fixnum(static_cast<Integer*>(v.get())->n));
+    else if (v->v_type == V_BOOL) slot = static_cast<Boolean*>(v.get())->b ? Expr(new True()) : Expr(new False());
+    else slot = Expr(new Constant(v.ptr));
+}
+
+void substituteGlobals(Expr &form, const std::map<std::string, Value> &known) {
+    if (!known.empty()) substitute(form, known);
+}
+
+// ============================================================================
+// Driver
+// ============================================================================
+
+void optimize(Expr &form, Assoc &env) {
+    convertAssignments(form);
+    liftLambdas(form);
+    analyzeBindings(form, env);
+    inferFixnums(form);
+    fuseListPipelines(form);
+}
@@ -0,0 +1,93 @@
+#ifndef OPTIMIZE_HPP
+#define OPTIMIZE_HPP
+
+/**
+ * @file optimize.hpp
+ * @brief Analysis and rewriting passes run on each parsed top-level form
+ *
+ * The REPL and the server run optimize() between parsing a form and
+ * evaluating it. Passes only annotate or rewrite the Expr tree. A form
+ * evaluates to the same result with or without them, except that lambda
+ * lifting does not preserve procedure identity (see liftLambdas).
+ */
+
+#include "Def.hpp"
+#include "expr.hpp"
+#include "value.hpp"
+#include <map>
+#include <string>
+
+/**
+ * @brief Run every pass on a form about to be evaluated under env
+ */
+void optimize(Expr &, Assoc &);
+
+/**
+ * @brief Assignment conversion: box only the local variables set! assigns
+ *
+ * Each local variable that is the target of some set! is bound to a Box,
+ * read with BoxRef and written with BoxSet (see expr.hpp). Every other
+ * binding is then never written after it is made and may be copied freely.
+ * A variable some define could shadow or replace at run time keeps its
+ * in-place updates. Runs first; the later passes see the converted tree.
+ */
+void convertAssignments(Expr &);
+
+/**
+ * @brief Lambda lifting: share the procedures of lambdas that capture no locals
+ *
+ * A lambda inside other code whose body refers only to its own variables
+ * and globals is marked closed (see Lambda). A letrec-bound lambda that is
+ * only ever called can also be closed by turning its free local variables
+ * into extra parameters passed at every call, provided their bindings
+ * are never written (a boxed variable passes its box). Must run before
+ * the binding and fixnum passes, which rely on the final parameter lists.
+ *
+ * Every evaluation of a closed lambda returns the same Procedure, so eq?
+ * and eqv? are #t on closures that would otherwise be distinct: with
+ * (define mk (lambda () (lambda (x) x))), (eq? (mk) (mk)) is #t.
+ */
+void liftLambdas(const Expr &);
+
+/**
+ * @brief Replace every variable named in known by its value
+ *
+ * Not part of optimize(): only batch mode (batch.hpp) knows which globals
+ * never change, and it guarantees that no name in known is ever bound
+ * locally, so no scope analysis is needed.
+ */
+void substituteGlobals(Expr &, const std::map<std::string, Value> &);
+
+/**
+ * @brief Binding analysis: mark known and global call sites (see Apply)
+ *
+ * Scopes are tracked statically, so a variable's position in the runtime
+ * environment is known at parse time. A scope whose body may add bindings
+ * at run time (an internal define, or rollback) makes every position
+ * through it unknown, and calls through it stay generic.
+ */
+void analyzeBindings(const Expr &, Assoc &);
+
+/**
+ * @brief Fixnum inference: compute proven-fixnum arithmetic unboxed
+ *
+ * A let variable is a fixnum if its initializer is. A parameter of a
+ * letrec-bound lambda is one if the lambda is only ever called, never
+ * passed around, and every call passes a fixnum in that position. Neither
+ * may be set! or redefined. Assumptions start optimistic and are dropped
+ * until they are consistent. Arithmetic and comparisons over proven
+ * operands become UnboxedFixnum nodes.
+ */
+void inferFixnums(Expr &);
+
+/**
+ * @brief List fusion: run nested map, filter and fold calls as one loop
+ *
+ * (fold k z (map f (filter p xs))) and any other chain of map and filter
+ * calls, with or without a fold around it, becomes a ListPipeline that
+ * builds no intermediate lists. Runs last, since the pipeline shares its
+ * operands with the calls it replaces.
+ */
+void fuseListPipelines(Expr &);
+
+#endif // OPTIMIZE_HPP
@@ -12,9 +12,12 @@
 #include "syntax.hpp"
 #include "value.hpp"
 #include "expr.hpp"
+#include "optimize.hpp"
+#include "pool.hpp"
 #include <map>
 #include <string>
 #include <iostream>
+#include <sstream>
 
 #define mp make_pair
 using std::string;
@@ -24,6 +27,143 @@ using std::pair;
 extern std::map<std::string, ExprType> primitives;
 extern std::map<std::string, ExprType> reserved_words;
 
+/**
+ * @brief Register a primitive node built for op against op's watchpoint
+ */
+template <class Node>
+static Expr watched(Node *node, const string &op) {
+    node->watch = primitiveWatch(op);
+    return Expr(node);
+}
+
+bool lazy_lambda_bodies = true;
+bool unsafe_mode = false;
+
+// Local scopes around the syntax being parsed
+static int local_depth = 0;
+
+// Lambdas declared unsafe around the syntax being parsed
+static int unsafe_depth = 0;
+
+static bool uncheckedCode() {
+    return unsafe_mode || unsafe_depth > 0;
+}
+
+/**
+ * @brief Parse as unchecked code for the lifetime of the object, if on
+ */
+struct UnsafeScope {
+    bool on;
+    UnsafeScope(bool on) : on(on) { if (on) ++unsafe_depth; }
+    ~UnsafeScope() { if (on) --unsafe_depth; }
+};
+
+/**
+ * @brief Whether stx is (declare (unsafe))
+ */
+static bool isUnsafeDeclaration(const Syntax &stx) {
+    List *l = dynamic_cast<List*>(stx.get());
+    if (l == nullptr || l->stxs.size() != 2) return false;
+    SymbolSyntax *head = dynamic_cast<SymbolSyntax*>(l->stxs[0].get());
+    List *spec = dynamic_cast<List*>(l->stxs[1].get());
+    if (head == nullptr || head->s != "declare" || spec == nullptr || spec->stxs.size() != 1) return false;
+    SymbolSyntax *what = dynamic_cast<SymbolSyntax*>(spec->stxs[0].get());
+    return what != nullptr && what->s == "unsafe";
+}
+
+/**
+ * @brief Whether a cond-style clause is (test => receiver)
+ */
+static bool isReceiverClause(const List *clause) {
+    if (clause->stxs.size() < 2) return false;
+    SymbolSyntax *arrow = dynamic_cast<SymbolSyntax*>(clause->stxs[1].get());
+    if (arrow == nullptr || arrow->s != "=>") return false;
+    if (clause->stxs.size() != 3) throw RuntimeError("=> clause needs exactly one receiver");
+    return true;
+}
+
+static Expr application(const Expr &rator, const vector<Expr> &rands) {
+    Apply *call = new Apply(rator, rands);
+    call->unchecked = uncheckedCode();
+    return Expr(call);
+}
+
+/**
+ * @brief Two-operand node of a numeric operation, check-free in unchecked code
+ */
+template <ExprType T>
+static Expr numericBinary(const vector<Expr> &rands, const string &op) {
+    if (uncheckedCode()) return watched(new UncheckedBinary<NumericOp<T> >(rands[0], rands[1]), op);
+    return watched(new NumericBinary<NumericOp<T> >(rands[0], rands[1]), op);
+}
+
+/**
+ * @brief The parse environment inside a scope binding names
+ *
+ * Only whether a name is bound matters to parsing, so locals are bound to
+ * a placeholder. A local that shadows a primitive is then called through
+ * Apply like any other variable.
+ */
+struct LocalScope {
+    Assoc env;
+    LocalScope(const std::vector<std::string> &names, const Assoc &outer) : env(outer) {
+        for (auto &x : names) env = extend(x, VoidV(), env);
+        ++local_depth;
+    }
+    ~LocalScope() { --local_depth; }
+};
+
+/**
+ * @brief Append syntax as text that readSyntax reads back to the same syntax
+ */
+static void writeSource(const Syntax &stx, std::string &out) {
+    SyntaxBase *s = stx.get();
+    if (Number *num = dynamic_cast<Number*>(s)) {
+        out += std::to_string(num->n);
+    } else if (RationalSyntax *rat = dynamic_cast<RationalSyntax*>(s)) {
+        out += std::to_string(rat->numerator) + "/" + std::to_string(rat->denominator);
+    } else if (dynamic_cast<TrueSyntax*>(s)) {
+        out += "#t";
+    } else if (dynamic_cast<FalseSyntax*>(s)) {
+        out += "#f";
+    } else if (SymbolSyntax *sym = dynamic_cast<SymbolSyntax*>(s)) {
+        out += sym->s;
+    } else if (StringSyntax *str = dynamic_cast<StringSyntax*>(s)) {
+        out += '"';
+        for (char c : str->s) {
+            if (c == '"' || c == '\\') out += '\\';
+            out += c;
+        }
+        out += '"';
+    } else if (List *lst = dynamic_cast<List*>(s)) {
+        out += '(';
+        for (size_t i = 0; i < lst->stxs.size(); ++i) {
+            if (i != 0) out += ' ';
+            writeSource(lst->stxs[i], out);
+        }
+        out += ')';
+    }
+}
+
+void LazyBody::force(Assoc &call_env) {
+    RegionPause pause;      // The parsed body outlives the call's form
+    // The call environment is the captured one plus the parameters
+    Assoc captured = call_env;
+    for (size_t i = 0; i < params.size(); ++i) captured = captured->next;
+    std::istringstream is(source);
+    Syntax stx = readSyntax(is);
+    Expr parsed(nullptr);
+    {
+        LocalScope scope(params, captured);
+        UnsafeScope unsafe(unchecked);
+        parsed = stx->parse(scope.env);
+    }
+    Expr form(new Lambda(params, parsed));
+    optimize(form, captured);
+    body = static_cast<Lambda*>(form.get())->e;
+    std::string().swap(source);
+}
+
 /**
  * @brief Default parse method (should be overridden by subclasses)
  */
@@ -70,7 +210,7 @@ Expr List::parse(Assoc &env) {
         for (size_t i = 1; i < stxs.size(); ++i) {
             args.push_back(stxs[i]->parse(env));
         }
-        return Expr(new Apply(stxs[0]->parse(env), args));
+        return application(stxs[0]->parse(env), args);
     } else {
         string op = id->s;
 
@@ -81,7 +221,7 @@ Expr List::parse(Assoc &env) {
                 parameters.push_back(stxs[i]->parse(env));
             }
             // Variable application: (op args...)
-            return Expr(new Apply(Expr(new Var(op)), parameters));
+            return application(Expr(new Var(op)), parameters);
         }
 
         // Primitive operations -> construct concrete Exprs
@@ -93,80 +233,181 @@ Expr List::parse(Assoc &env) {
 
             ExprType op_type = primitives[op];
             if (op_type == E_PLUS) {
-                if (parameters.size() == 2) {
-                    return Expr(new Plus(parameters[0], parameters[1]));
-                } else {
-                    throw RuntimeError("Wrong number of arguments for +");
-                }
+                if (parameters.size() == 2) return numericBinary<E_PLUS>(parameters, op);
+                return watched(new PlusVar(parameters), op);
             } else if (op_type == E_MINUS) {
-                if (parameters.size() == 2) return Expr(new Minus(parameters[0], parameters[1]));
-                throw RuntimeError("Wrong number of arguments for -");
+                if (parameters.size() == 2) return numericBinary<E_MINUS>(parameters, op);
+                if (parameters.empty()) throw RuntimeError("Wrong number of arguments for -");
+                return watched(new MinusVar(parameters), op);
             } else if (op_type == E_MUL) {
-                if (parameters.size() == 2) return Expr(new Mult(parameters[0], parameters[1]));
-                throw RuntimeError("Wrong number of arguments for *");
-            }  else if (op_type == E_DIV) {
-                if (parameters.size() == 2) return Expr(new Div(parameters[0], parameters[1]));
-                throw RuntimeError("Wrong number of arguments for /");
+                if (parameters.size() == 2) return numericBinary<E_MUL>(parameters, op);
+                return watched(new MultVar(parameters), op);
+            } else if (op_type == E_DIV) {
+                if (parameters.size() == 2) return numericBinary<E_DIV>(parameters, op);
+                if (parameters.empty()) throw RuntimeError("Wrong number of arguments for /");
+                return watched(new DivVar(parameters), op);
             } else if (op_type == E_MODULO) {
                 if (parameters.size() != 2) {
                     throw RuntimeError("Wrong number of arguments for modulo");
                 }
-                return Expr(new Modulo(parameters[0], parameters[1]));
+                return watched(new Modulo(parameters[0], parameters[1]), op);
+            } else if (op_type == E_EXPT) {
+                if (parameters.size() != 2) throw RuntimeError("Wrong number of arguments for expt");
+                return watched(new Expt(parameters[0], parameters[1]), op);
+            } else if (op_type == E_QUOTIENT) {
+                if (parameters.size() != 2) throw RuntimeError("Wrong number of arguments for quotient");
+                return watched(new Quotient(parameters[0], parameters[1]), op);
+            } else if (op_type == E_REMAINDER) {
+                if (parameters.size() != 2) throw RuntimeError("Wrong number of arguments for remainder");
+                return watched(new Remainder(parameters[0], parameters[1]), op);
+            } else if (op_type == E_GCD) {
+                return watched(new Gcd(parameters), op);
+            } else if (op_type == E_LCM) {
+                return watched(new Lcm(parameters), op);
+            } else if (op_type == E_EXACT_INT_SQRT) {
+                if (parameters.size() != 1) throw RuntimeError("Wrong number of arguments for exact-integer-sqrt");
+                return watched(new ExactIntSqrt(parameters[0]), op);
+            } else if (op_type == E_EXPT_MOD) {
+                if (parameters.size() != 3) throw RuntimeError("Wrong number of arguments for expt-mod");
+                return watched(new ExptMod(parameters), op);
+            } else if (op_type == E_PRIMEQ) {
+                if (parameters.size() != 1) throw RuntimeError("Wrong number of arguments for prime?");
+                return watched(new IsPrime(parameters[0]), op);
+            } else if (op_type == E_LT) {
+                if (parameters.size() == 2) return numericBinary<E_LT>(parameters, op);
+                if (parameters.empty()) throw RuntimeError("Wrong number of arguments for <");
+                return watched(new LessVar(parameters), op);
+            } else if (op_type == E_LE) {
+                if (parameters.size() == 2) return numericBinary<E_LE>(parameters, op);
+                if (parameters.empty()) throw RuntimeError("Wrong number of arguments for <=");
+                return watched(new LessEqVar(parameters), op);
+            } else if (op_type == E_EQ) {
+                if (parameters.size() == 2) return numericBinary<E_EQ>(parameters, op);
+                if (parameters.empty()) throw RuntimeError("Wrong number of arguments for =");
+                return watched(new EqualVar(parameters), op);
+            } else if (op_type == E_GE) {
+                if (parameters.size() == 2) return numericBinary<E_GE>(parameters, op);
+                if (parameters.empty()) throw RuntimeError("Wrong number of arguments for >=");
+                return watched(new GreaterEqVar(parameters), op);
+            } else if (op_type == E_GT) {
+                if (parameters.size() == 2) return numericBinary<E_GT>(parameters, op);
+                if (parameters.empty()) throw RuntimeError("Wrong number of arguments for >");
+                return watched(new GreaterVar(parameters), op);
             } else if (op_type == E_LIST) {
-                return Expr(new ListFunc(parameters));
+                return watched(new ListFunc(parameters), op);
             } else if (op_type == E_CONS) {
                 if (parameters.size() != 2) throw RuntimeError("Wrong number of arguments for cons");
-                return Expr(new Cons(parameters[0], parameters[1]));
+                return watched(new Cons(parameters[0], parameters[1]), op);
             } else if (op_type == E_CAR) {
                 if (parameters.size() != 1) throw RuntimeError("Wrong number of arguments for car");
-                return Expr(new Car(parameters[0]));
+                if (uncheckedCode()) return watched(new UncheckedCar(parameters[0]), op);
+                return watched(new Car(parameters[0]), op);
             } else if (op_type == E_CDR) {
                 if (parameters.size() != 1) throw RuntimeError("Wrong number of arguments for cdr");
-                return Expr(new Cdr(parameters[0]));
+                if (uncheckedCode()) return watched(new UncheckedCdr(parameters[0]), op);
+                return watched(new Cdr(parameters[0]), op);
             } else if (op_type == E_SETCAR) {
                 if (parameters.size() != 2) throw RuntimeError("Wrong number of arguments for set-car!");
-                return Expr(new SetCar(parameters[0], parameters[1]));
+                return watched(new SetCar(parameters[0], parameters[1]), op);
+            } else if (op_type == E_MAP) {
+                if (parameters.size() != 2) throw RuntimeError("Wrong number of arguments for map");
+                return watched(new Map(parameters[0], parameters[1]), op);
+            } else if (op_type == E_FILTER) {
+                if (parameters.size() != 2) throw RuntimeError("Wrong number of arguments for filter");
+                return watched(new Filter(parameters[0], parameters[1]), op);
+            } else if (op_type == E_FOLD) {
+                if (parameters.size() != 3) throw RuntimeError("Wrong number of arguments for fold");
+                return watched(new Fold(parameters), op);
             } else if (op_type == E_SETCDR) {
                 if (parameters.size() != 2) throw RuntimeError("Wrong number of arguments for set-cdr!");
-                return Expr(new SetCdr(parameters[0], parameters[1]));
+                return watched(new SetCdr(parameters[0], parameters[1]), op);
+            } else if (op_type == E_MEMBER) {
+                if (parameters.size() != 2) throw RuntimeError("Wrong number of arguments for member");
+                return watched(new MemberFunc(parameters[0], parameters[1]), op);
+            } else if (op_type == E_ASSOC) {
+                if (parameters.size() != 2) throw RuntimeError("Wrong number of arguments for assoc");
+                return watched(new AssocFunc(parameters[0], parameters[1]), op);
             } else if (op_type == E_NOT) {
                 if (parameters.size() != 1) throw RuntimeError("Wrong number of arguments for not");
-                return Expr(new Not(parameters[0]));
+                return watched(new Not(parameters[0]), op);
+            } else if (op_type == E_AND) {
+                return watched(new AndVar(parameters), op);
+            } else if (op_type == E_OR) {
+                return watched(new OrVar(parameters), op);
             } else if (op_type == E_DISPLAY) {
                 if (parameters.size() != 1) throw RuntimeError("Wrong number of arguments for display");
-                return Expr(new Display(parameters[0]));
+                return watched(new Display(parameters[0]), op);
             } else if (op_type == E_EQQ) {
                 if (parameters.size() != 2) throw RuntimeError("Wrong number of arguments for eq?");
-                return Expr(new IsEq(parameters[0], parameters[1]));
+                return watched(new IsEq(parameters[0], parameters[1]), op);
+            } else if (op_type == E_EQVQ) {
+                if (parameters.size() != 2) throw RuntimeError("Wrong number of arguments for eqv?");
+                return watched(new IsEqv(parameters[0], parameters[1]), op);
+            } else if (op_type == E_EQUALQ) {
+                if (parameters.size() != 2) throw RuntimeError("Wrong number of arguments for equal?");
+                return watched(new IsEqual(parameters[0], parameters[1]), op);
             } else if (op_type == E_BOOLQ) {
                 if (parameters.size() != 1) throw RuntimeError("Wrong number of arguments for boolean?");
-                return Expr(new IsBoolean(parameters[0]));
+                return watched(new IsBoolean(parameters[0]), op);
             } else if (op_type == E_INTQ) {
                 if (parameters.size() != 1) throw RuntimeError("Wrong number of arguments for number?");
-                return Expr(new IsFixnum(parameters[0]));
+                return watched(new IsFixnum(parameters[0]), op);
             } else if (op_type == E_NULLQ) {
                 if (parameters.size() != 1) throw RuntimeError("Wrong number of arguments for null?");
-                return Expr(new IsNull(parameters[0]));
+                return watched(new IsNull(parameters[0]), op);
             } else if (op_type == E_PAIRQ) {
                 if (parameters.size() != 1) throw RuntimeError("Wrong number of arguments for pair?");
-                return Expr(new IsPair(parameters[0]));
+                return watched(new IsPair(parameters[0]), op);
             } else if (op_type == E_PROCQ) {
                 if (parameters.size() != 1) throw RuntimeError("Wrong number of arguments for procedure?");
-                return Expr(new IsProcedure(parameters[0]));
+                return watched(new IsProcedure(parameters[0]), op);
             } else if (op_type == E_SYMBOLQ) {
                 if (parameters.size() != 1) throw RuntimeError("Wrong number of arguments for symbol?");
-                return Expr(new IsSymbol(parameters[0]));
+                return watched(new IsSymbol(parameters[0]), op);
             } else if (op_type == E_LISTQ) {
                 if (parameters.size() != 1) throw RuntimeError("Wrong number of arguments for list?");
-                return Expr(new IsList(parameters[0]));
+                return watched(new IsList(parameters[0]), op);
             } else if (op_type == E_STRINGQ) {
                 if (parameters.size() != 1) throw RuntimeError("Wrong number of arguments for string?");
-                return Expr(new IsString(parameters[0]));
+                return watched(new IsString(parameters[0]), op);
+            } else if (op_type == E_CHECKPOINT) {
+                if (parameters.size() != 0) throw RuntimeError("Wrong number of arguments for checkpoint");
+                return watched(new MakeCheckpoint(), op);
+            } else if (op_type == E_ROLLBACK) {
+                if (parameters.size() != 1) throw RuntimeError("Wrong number of arguments for rollback");
+                return watched(new Rollback(parameters[0]), op);
+            } else if (op_type == E_RAISE) {
+                if (parameters.size() != 1) throw RuntimeError("Wrong number of arguments for raise");
+                return watched(new Raise(parameters[0]), op);
+            } else if (op_type == E_RAISE_CONTINUABLE) {
+                if (parameters.size() != 1) throw RuntimeError("Wrong number of arguments for raise-continuable");
+                return watched(new RaiseContinuable(parameters[0]), op);
+            } else if (op_type == E_ERROR) {
+                if (parameters.size() < 1) throw RuntimeError("Wrong number of arguments for error");
+                return watched(new ErrorFunc(parameters), op);
+            } else if (op_type == E_WITH_HANDLER) {
+                if (parameters.size() != 2) throw RuntimeError("Wrong number of arguments for with-exception-handler");
+                return watched(new WithHandler(parameters[0], parameters[1]), op);
+            } else if (op_type == E_ERRORQ) {
+                if (parameters.size() != 1) throw RuntimeError("Wrong number of arguments for error-object?");
+                return watched(new IsErrorObject(parameters[0]), op);
+            } else if (op_type == E_ERROR_MESSAGE) {
+                if (parameters.size() != 1) throw RuntimeError("Wrong number of arguments for error-object-message");
+                return watched(new ErrorObjectMessage(parameters[0]), op);
+            } else if (op_type == E_ERROR_IRRITANTS) {
+                if (parameters.size() != 1) throw RuntimeError("Wrong number of arguments for error-object-irritants");
+                return watched(new ErrorObjectIrritants(parameters[0]), op);
+            } else if (op_type == E_VOID) {
+                if (parameters.size() != 0) throw RuntimeError("Wrong number of arguments for void");
+                return watched(new MakeVoid(), op);
+            } else if (op_type == E_EXIT) {
+                if (parameters.size() != 0) throw RuntimeError("Wrong number of arguments for exit");
+                return watched(new Exit(), op);
             } else {
                 // Default: treat as Apply of operator symbol
                 vector<Expr> params;
                 for (size_t i = 1; i < stxs.size(); ++i) params.push_back(stxs[i]->parse(env));
-                return Expr(new Apply(Expr(new Var(op)), params));
+                return application(Expr(new Var(op)), params);
             }
         }
 
@@ -197,8 +438,17 @@ Expr List::parse(Assoc &env) {
                         if (!sid) throw RuntimeError("lambda param must be symbol");
                         params.push_back(sid->s);
                     }
-                    // body is single expression for now
-                    Expr body = stxs[2]->parse(env);
+                    // body is single expression for now, optionally after (declare (unsafe))
+                    bool declared_unsafe = stxs.size() > 3 && isUnsafeDeclaration(stxs[2]);
+                    const Syntax &body_stx = stxs[declared_unsafe ? 3 : 2];
+                    if (lazy_lambda_bodies && local_depth == 0) {
+                        std::string source;
+                        writeSource(body_stx, source);
+                        return Expr(new Lambda(params, Expr(new LazyBody(source, params, declared_unsafe))));
+                    }
+                    LocalScope scope(params, env);
+                    UnsafeScope unsafe(declared_unsafe);
+                    Expr body = body_stx->parse(scope.env);
                     return Expr(new Lambda(params, body));
                 }
                 case E_DEFINE: {
@@ -213,14 +463,17 @@ Expr List::parse(Assoc &env) {
                     List* binds = dynamic_cast<List*>(stxs[1].get());
                     if (!binds) throw RuntimeError("let bindings must be list");
                     std::vector<std::pair<std::string, Expr>> vec;
+                    std::vector<std::string> names;
                     for (auto &b : binds->stxs) {
                         List* pairlst = dynamic_cast<List*>(b.get());
                         if (!pairlst || pairlst->stxs.size() != 2) throw RuntimeError("let binding must be (name expr)");
                         SymbolSyntax* sid = dynamic_cast<SymbolSyntax*>(pairlst->stxs[0].get());
                         if (!sid) throw RuntimeError("let binding name must be symbol");
                         vec.push_back({sid->s, pairlst->stxs[1]->parse(env)});
+                        names.push_back(sid->s);
                     }
-                    Expr body = stxs[2]->parse(env);
+                    LocalScope scope(names, env);
+                    Expr body = stxs[2]->parse(scope.env);
                     return Expr(new Let(vec, body));
                 }
                 case E_LETREC: {
@@ -228,15 +481,20 @@ Expr List::parse(Assoc &env) {
                     if (stxs.size() < 3) throw RuntimeError("Wrong number of arguments for letrec");
                     List* binds = dynamic_cast<List*>(stxs[1].get());
                     if (!binds) throw RuntimeError("letrec bindings must be list");
-                    std::vector<std::pair<std::string, Expr>> vec;
+                    std::vector<std::string> names;
                     for (auto &b : binds->stxs) {
                         List* pairlst = dynamic_cast<List*>(b.get());
                         if (!pairlst || pairlst->stxs.size() != 2) throw RuntimeError("letrec binding must be (name expr)");
                         SymbolSyntax* sid = dynamic_cast<SymbolSyntax*>(pairlst->stxs[0].get());
                         if (!sid) throw RuntimeError("letrec binding name must be symbol");
-                        vec.push_back({sid->s, pairlst->stxs[1]->parse(env)});
+                        names.push_back(sid->s);
                     }
-                    Expr body = stxs[2]->parse(env);
+                    // Initializers are in the scope of every binding
+                    LocalScope scope(names, env);
+                    std::vector<std::pair<std::string, Expr>> vec;
+                    for (size_t i = 0; i < names.size(); ++i)
+                        vec.push_back({names[i], static_cast<List*>(binds->stxs[i].get())->stxs[1]->parse(scope.env)});
+                    Expr body = stxs[2]->parse(scope.env);
                     return Expr(new Letrec(vec, body));
                 }
                 case E_SET: {
@@ -259,6 +517,79 @@ Expr List::parse(Assoc &env) {
                     }
                     return Expr(new Cond(clauses));
                 }
+                case E_CASE: {
+                    // (case key ((datum...) expr...) ... (else expr...))
+                    if (stxs.size() < 2) throw RuntimeError("Wrong number of arguments for case");
+                    Case *node = new Case(stxs[1]->parse(env));
+                    Expr result(node);
+                    for (size_t i = 2; i < stxs.size(); ++i) {
+                        List* clause = dynamic_cast<List*>(stxs[i].get());
+                        if (!clause || clause->stxs.empty()) throw RuntimeError("case clause must be a list");
+                        int index = (int)node->bodies.size();
+                        node->receivers.push_back(isReceiverClause(clause));
+                        if (node->receivers.back()) {
+                            node->bodies.push_back(clause->stxs[2]->parse(env));
+                        } else {
+                            std::vector<Expr> seq;
+                            for (size_t j = 1; j < clause->stxs.size(); ++j) seq.push_back(clause->stxs[j]->parse(env));
+                            node->bodies.push_back(Expr(new Begin(seq)));
+                        }
+
+                        SymbolSyntax* head = dynamic_cast<SymbolSyntax*>(clause->stxs[0].get());
+                        if (head && head->s == "else") {
+                            if (node->else_clause < 0) node->else_clause = index;
+                            continue;
+                        }
+                        List* datums = dynamic_cast<List*>(clause->stxs[0].get());
+                        if (!datums) throw RuntimeError("case clause must start with a datum list");
+                        for (auto &d : datums->stxs) {
+                            // Datums that can never be eqv? to a key (strings, lists) are dropped
+                            if (Number* num = dynamic_cast<Number*>(d.get())) {
+                                node->addFixnum(num->n, index);
+                            } else if (RationalSyntax* rat = dynamic_cast<RationalSyntax*>(d.get())) {
+                                node->addRational(rat->numerator, rat->denominator, index);
+                            } else if (SymbolSyntax* sym = dynamic_cast<SymbolSyntax*>(d.get())) {
+                                node->symbols.insert(std::make_pair(sym->s, index));
+                            } else if (dynamic_cast<TrueSyntax*>(d.get())) {
+                                if (node->booleans[1] < 0) node->booleans[1] = index;
+                            } else if (dynamic_cast<FalseSyntax*>(d.get())) {
+                                if (node->booleans[0] < 0) node->booleans[0] = index;
+                            } else if (List* lst = dynamic_cast<List*>(d.get())) {
+                                if (lst->stxs.empty() && node->null_clause < 0) node->null_clause = index;
+                            }
+                        }
+                    }
+                    node->buildJumpTable();
+                    return result;
+                }
+                case E_GUARD: {
+                    // (guard (var clause...) body...)
+                    if (stxs.size() < 3) throw RuntimeError("Wrong number of arguments for guard");
+                    List* spec = dynamic_cast<List*>(stxs[1].get());
+                    if (!spec || spec->stxs.empty()) throw RuntimeError("guard needs (var clause...)");
+                    SymbolSyntax* var = dynamic_cast<SymbolSyntax*>(spec->stxs[0].get());
+                    if (!var) throw RuntimeError("guard variable must be symbol");
+                    std::vector<std::pair<Expr, Expr>> clauses;
+                    std::vector<bool> receivers;
+                    for (size_t i = 1; i < spec->stxs.size(); ++i) {
+                        List* clause = dynamic_cast<List*>(spec->stxs[i].get());
+                        if (!clause || clause->stxs.empty()) throw RuntimeError("guard clause must be a list");
+                        SymbolSyntax* head = dynamic_cast<SymbolSyntax*>(clause->stxs[0].get());
+                        LocalScope scope(std::vector<std::string>(1, var->s), env);
+                        Expr test = (head && head->s == "else") ? Expr(new True()) : clause->stxs[0]->parse(scope.env);
+                        receivers.push_back(isReceiverClause(clause));
+                        if (receivers.back()) {
+                            clauses.push_back({test, clause->stxs[2]->parse(scope.env)});
+                            continue;
+                        }
+                        std::vector<Expr> seq;
+                        for (size_t j = 1; j < clause->stxs.size(); ++j) seq.push_back(clause->stxs[j]->parse(scope.env));
+                        clauses.push_back({test, seq.empty() ? Expr(nullptr) : Expr(new Begin(seq))});
+                    }
+                    std::vector<Expr> body;
+                    for (size_t i = 2; i < stxs.size(); ++i) body.push_back(stxs[i]->parse(env));
+                    return Expr(new Guard(var->s, clauses, receivers, Expr(new Begin(body))));
+                }
                 default:
                     throw RuntimeError("Unknown reserved word: " + op);
             }
@@ -269,6 +600,6 @@ Expr List::parse(Assoc &env) {
         for (size_t i = 1; i < stxs.size(); ++i) {
             parameters.push_back(stxs[i]->parse(env));
         }
-        return Expr(new Apply(Expr(new Var(op)), parameters));
+        return application(Expr(new Var(op)), parameters);
     }
 }
@@ -0,0 +1,236 @@
+/**
+ * @file pool.cpp
+ * @brief Slabs, free lists and regions behind PoolAllocator
+ *
+ * All pool memory is carved from POOL_SLAB_BYTES chunks aligned to their
+ * size, so the chunk holding a block is found by masking its address.
+ */
+
+#include "pool.hpp"
+#include <vector>
+#include <cstdint>
+
+/**
+ * @brief Header at the start of every pool chunk
+ */
+struct Chunk {
+    bool region;        ///< Bump-only region chunk rather than a size-class slab
+    size_t live;        ///< Region chunks: blocks not yet freed
+    char *bump;         ///< Next unused byte
+    char *limit;        ///< End of the chunk
+    Chunk *next_free;   ///< Link in the list of recycled chunks
+};
+
+const size_t CHUNK_HEADER = (sizeof(Chunk) + POOL_GRANULE - 1) / POOL_GRANULE * POOL_GRANULE;
+const size_t CHUNK_BATCH = 16;          ///< Chunks obtained from the system at once
+
+static Chunk *free_chunks = nullptr;
+
+static Chunk *chunkOf(void *p) {
+    return reinterpret_cast<Chunk *>(reinterpret_cast<uintptr_t>(p) & ~(uintptr_t)(POOL_SLAB_BYTES - 1));
+}
+
+static Chunk *newChunk(bool region) {
+    if (free_chunks == nullptr) {
+        // One spare chunk of slack lets the batch be aligned
+        char *raw = static_cast<char *>(::operator new((CHUNK_BATCH + 1) * POOL_SLAB_BYTES));
+        char *base = reinterpret_cast<char *>(
+            (reinterpret_cast<uintptr_t>(raw) + POOL_SLAB_BYTES - 1) & ~(uintptr_t)(POOL_SLAB_BYTES - 1));
+        for (size_t i = CHUNK_BATCH; i-- > 0; ) {
+            Chunk *c = reinterpret_cast<Chunk *>(base + i * POOL_SLAB_BYTES);
+            c->next_free = free_chunks;
+            free_chunks = c;
+        }
+    }
+    Chunk *c = free_chunks;
+    free_chunks = c->next_free;
+    c->region = region;
+    c->live = 0;
+    c->bump = reinterpret_cast<char *>(c) + CHUNK_HEADER;
+    c->limit = reinterpret_cast<char *>(c) + POOL_SLAB_BYTES;
+    c->next_free = nullptr;
+    return c;
+}
+
+static void recycleChunk(Chunk *c) {
+    c->next_free = free_chunks;
+    free_chunks = c;
+}
+
+// ============================================================================
+// Size classes
+// ============================================================================
+
+/**
+ * @brief Free list and current slab for one block size
+ */
+struct SizeClass {
+    void *free_list;    ///< Freed blocks, linked through their first word
+    Chunk *slab;        ///< Slab being bumped through
+};
+
+static SizeClass size_classes[POOL_MAX_BLOCK / POOL_GRANULE];
+
+// ============================================================================
+// Regions
+// ============================================================================
+
+static bool region_active = false;
+static Chunk *region_chunk = nullptr;   // Chunk the open region bumps through
+
+void regionBegin() {
+    region_active = true;
+}
+
+void regionEnd() {
+    region_active = false;
+    if (region_chunk == nullptr) return;
+    // Survivors pin the chunk; it is recycled when the last of them is freed
+    if (region_chunk->live == 0) recycleChunk(region_chunk);
+    region_chunk = nullptr;
+}
+
+RegionPause::RegionPause() : active(region_active) {
+    region_active = false;
+}
+
+RegionPause::~RegionPause() {
+    region_active = active;
+}
+
+void *poolAllocate(size_t size) {
+    if (size > POOL_MAX_BLOCK) return ::operator new(size);
+    size_t index = (size - 1) / POOL_GRANULE;
+    size_t block = (index + 1) * POOL_GRANULE;
+    if (region_active) {
+        if (region_chunk == nullptr || region_chunk->limit - region_chunk->bump < (ptrdiff_t)block) {
+            if (region_chunk != nullptr && region_chunk->live == 0) recycleChunk(region_chunk);
+            region_chunk = newChunk(true);
+        }
+        void *p = region_chunk->bump;
+        region_chunk->bump += block;
+        ++region_chunk->live;
+        return p;
+    }
+    SizeClass &sc = size_classes[index];
+    if (sc.free_list != nullptr) {
+        void *p = sc.free_list;
+        sc.free_list = *static_cast<void **>(p);
+        return p;
+    }
+    if (sc.slab == nullptr || sc.slab->limit - sc.slab->bump < (ptrdiff_t)block)
+        sc.slab = newChunk(false);
+    void *p = sc.slab->bump;
+    sc.slab->bump += block;
+    return p;
+}
+
+void poolFree(void *p, size_t size) {
+    if (size > POOL_MAX_BLOCK) {
+        ::operator delete(p);
+        return;
+    }
+    Chunk *c = chunkOf(p);
+    if (c->region) {
+        if (--c->live == 0 && c != region_chunk) recycleChunk(c);
+        return;
+    }
+    SizeClass &sc = size_classes[(size - 1) / POOL_GRANULE];
+    *static_cast<void **>(p) = sc.free_list;
+    sc.free_list = p;
+}
+
+// ============================================================================
+// Pair space
+// ============================================================================
+
+const size_t PAIR_SLAB_BYTES = 1 << 20;                 ///< Slabs are aligned to their size
+const size_t PAIR_SLAB_MAX_CELLS = PAIR_SLAB_BYTES / POOL_GRANULE;
+const size_t PAIR_MAP_WORDS = PAIR_SLAB_MAX_CELLS / 64;
+const size_t PAIR_SLAB_BATCH = 8;                       ///< Slabs obtained from the system at once
+
+/**
+ * @brief Header at the start of every pair slab
+ */
+struct PairSlab {
+    uint64_t used[PAIR_MAP_WORDS];  ///< Occupancy bitmap, one bit per cell
+    size_t hint;                    ///< No free cell below this bitmap word
+    size_t index;                   ///< Position in pair_slabs
+    char *cells;                    ///< First cell
+};
+
+static std::vector<PairSlab *> pair_slabs;
+static size_t pair_first_free = 0;      // No free cell in slabs below this index
+static size_t pair_cell_bytes = 0;
+static size_t pair_slab_cells = 0;
+static size_t pair_live = 0;
+static char *pair_spare = nullptr;      // Aligned slabs not yet in use
+static char *pair_spare_end = nullptr;
+
+static PairSlab *newPairSlab() {
+    if (pair_spare == pair_spare_end) {
+        // One slab of slack lets the batch be aligned, as for size-class chunks
+        char *raw = static_cast<char *>(::operator new((PAIR_SLAB_BATCH + 1) * PAIR_SLAB_BYTES));
+        pair_spare = reinterpret_cast<char *>(
+            (reinterpret_cast<uintptr_t>(raw) + PAIR_SLAB_BYTES - 1) & ~(uintptr_t)(PAIR_SLAB_BYTES - 1));
+        pair_spare_end = pair_spare + PAIR_SLAB_BATCH * PAIR_SLAB_BYTES;
+    }
+    char *base = pair_spare;
+    pair_spare += PAIR_SLAB_BYTES;
+    PairSlab *slab = new (base) PairSlab();
+    size_t header = (sizeof(PairSlab) + pair_cell_bytes - 1) / pair_cell_bytes * pair_cell_bytes;
+    slab->cells = base + header;
+    slab->hint = 0;
+    slab->index = pair_slabs.size();
+    // Cells past the end of the slab are marked used so they are never handed out
+    for (size_t i = pair_slab_cells; i < PAIR_SLAB_MAX_CELLS; ++i)
+        slab->used[i / 64] |= (uint64_t)1 << (i % 64);
+    pair_slabs.push_back(slab);
+    return slab;
+}
+
+void *PairSpace::allocate(size_t size) {
+    if (pair_cell_bytes == 0) {
+        pair_cell_bytes = (size + POOL_GRANULE - 1) / POOL_GRANULE * POOL_GRANULE;
+        size_t header = (sizeof(PairSlab) + pair_cell_bytes - 1) / pair_cell_bytes * pair_cell_bytes;
+        pair_slab_cells = (PAIR_SLAB_BYTES - header) / pair_cell_bytes;
+    }
+    if (size > pair_cell_bytes) return ::operator new(size);
+    for (size_t s = pair_first_free; s <= pair_slabs.size(); ++s) {
+        PairSlab *slab = s < pair_slabs.size() ? pair_slabs[s] : newPairSlab();
+        for (size_t w = slab->hint; w < PAIR_MAP_WORDS; ++w) {
+            uint64_t free_bits = ~slab->used[w];
+            if (free_bits == 0) continue;
+            size_t bit = __builtin_ctzll(free_bits);
+            slab->used[w] |= (uint64_t)1 << bit;
+            slab->hint = w;
+            pair_first_free = s;
+            ++pair_live;
+            return slab->cells + (w * 64 + bit) * pair_cell_bytes;
+        }
+        slab->hint = PAIR_MAP_WORDS;
+    }
+    return nullptr;     // unreachable: the loop ends with a fresh slab
+}
+
+void PairSpace::free(void *p, size_t size) {
+    if (size > pair_cell_bytes) {
+        ::operator delete(p);
+        return;
+    }
+    PairSlab *slab = reinterpret_cast<PairSlab *>(
+        reinterpret_cast<uintptr_t>(p) & ~(uintptr_t)(PAIR_SLAB_BYTES - 1));
+    size_t cell = (static_cast<char *>(p) - slab->cells) / pair_cell_bytes;
+    slab->used[cell / 64] &= ~((uint64_t)1 << (cell % 64));
+    if (cell / 64 < slab->hint) slab->hint = cell / 64;
+    if (slab->index < pair_first_free) pair_first_free = slab->index;
+    --pair_live;
+}
+
+size_t PairSpace::liveCells() {
+    return pair_live;
+}
+
+size_t PairSpace::cellBytes() {
+    return pair_cell_bytes;
+}
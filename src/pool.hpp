@@ -0,0 +1,123 @@
+#ifndef POOL_HPP
+#define POOL_HPP
+
+/**
+ * @file pool.hpp
+ * @brief Size-class slab allocator for small runtime objects
+ *
+ * Values and environment nodes are created through std::allocate_shared with
+ * PoolAllocator, so the object and its shared_ptr control block are one
+ * block taken from a slab. Every block size (rounded up to POOL_GRANULE)
+ * has its own free list. Allocation pops a free block or bumps a pointer in
+ * the current slab, and freeing pushes the block back. Slabs are never
+ * returned to the system, so blocks of one size stay together and list
+ * traversals touch fewer cache lines.
+ *
+ * Between regionBegin() and regionEnd() small objects are instead bumped
+ * into region chunks that keep only a count of live blocks. Freeing a
+ * block decrements the count, and a chunk whose count reaches zero is
+ * recycled whole. A value cannot move once made, so what is known to
+ * outlive the form is made outside the region: define and set! evaluate
+ * the value they store under a RegionPause. A value that escapes another
+ * way, such as set-car! into a global list, stays where it is and pins
+ * its chunk until it dies.
+ *
+ * Pairs live in a separate pair space (PairSpace) so cons cells never mix
+ * with other objects and are handed out in address order.
+ */
+
+#include <cstddef>
+#include <new>
+
+const size_t POOL_GRANULE = 16;        ///< Block sizes are multiples of this
+const size_t POOL_MAX_BLOCK = 256;     ///< Larger requests use operator new
+const size_t POOL_SLAB_BYTES = 64 * 1024;
+
+/**
+ * @brief Take one block of at least the given size
+ */
+void *poolAllocate(size_t);
+
+/**
+ * @brief Return a block obtained from poolAllocate with the same size
+ */
+void poolFree(void *, size_t);
+
+/**
+ * @brief Start bump-allocating small objects into a region
+ */
+void regionBegin();
+
+/**
+ * @brief Close the open region; its chunk is recycled once nothing in it is live
+ */
+void regionEnd();
+
+/**
+ * @brief Allocate from the size classes, not the open region, while alive
+ */
+struct RegionPause {
+    bool active;    ///< Whether a region was open
+    RegionPause();
+    ~RegionPause();
+};
+
+/**
+ * @brief The general size-class pools
+ */
+struct SizeClassSpace {
+    static void *allocate(size_t size) { return poolAllocate(size); }
+    static void free(void *p, size_t size) { poolFree(p, size); }
+};
+
+/**
+ * @brief Dedicated space for cons cells
+ *
+ * Cells are one fixed size (a Pair and its control block, 64 bytes on
+ * x86-64) and are carved from 1 MB slabs tracked by an occupancy bitmap.
+ * Allocation always takes the lowest free cell, so a list built by
+ * successive conses occupies consecutive addresses and traversing it is a
+ * forward memory scan, even after earlier lists have been freed. This only
+ * changes where cells live, not their size: a Pair still holds two
+ * shared_ptr Values, so a million-element list takes about 64 MB.
+ */
+struct PairSpace {
+    static void *allocate(size_t);
+    static void free(void *, size_t);
+    static size_t liveCells();      ///< Cells currently in use
+    static size_t cellBytes();      ///< Bytes per cell, 0 before the first cons
+};
+
+/**
+ * @brief Standard allocator backed by one of the pool spaces
+ */
+template <typename T, typename Space = SizeClassSpace>
+struct PoolAllocator {
+    typedef T value_type;
+
+    PoolAllocator() {}
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U, Space> &) {}
+
+    T *allocate(size_t n) {
+        if (n != 1 || alignof(T) > POOL_GRANULE)
+            return static_cast<T *>(::operator new(n * sizeof(T)));
+        return static_cast<T *>(Space::allocate(sizeof(T)));
+    }
+
+    void deallocate(T *p, size_t n) {
+        if (n != 1 || alignof(T) > POOL_GRANULE) {
+            ::operator delete(p);
+            return;
+        }
+        Space::free(p, sizeof(T));
+    }
+};
+
+template <typename T, typename U, typename Space>
+bool operator==(const PoolAllocator<T, Space> &, const PoolAllocator<U, Space> &) { return true; }
+
+template <typename T, typename U, typename Space>
+bool operator!=(const PoolAllocator<T, Space> &, const PoolAllocator<U, Space> &) { return false; }
+
+#endif // POOL_HPP
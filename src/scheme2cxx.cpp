@@ -0,0 +1,718 @@
+/**
+ * @file scheme2cxx.cpp
+ * @brief Ahead-of-time compiler from Scheme source to C++
+ *
+ * Usage: scheme2cxx input.scm output.cpp
+ *
+ * Forms are read and parsed with the interpreter's own reader and parser
+ * (List::parse), and the resulting Expr trees are emitted as C++ linked
+ * against the runtime library:
+ *  - one function per top-level form and one per lambda; a lambda value is
+ *    a Procedure whose body is a NativeCode node calling that function;
+ *  - primitives call evalRator on a static node of the same class, so they
+ *    share the interpreter's exact semantics and error behaviour;
+ *  - a call to a top-level procedure that is defined once and never set!
+ *    is a direct C++ call, skipping the type test, arity check and lookup;
+ *  - arithmetic and comparisons over fixnum literals are computed unboxed.
+ *
+ * Evaluation order mirrors the interpreter (right to left for binary
+ * primitives, left to right elsewhere) so the output is identical.
+ * guard and rollback are not supported and make the compiler fail.
+ */
+
+#include "Def.hpp"
+#include "syntax.hpp"
+#include "expr.hpp"
+#include "value.hpp"
+#include "RE.hpp"
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+using std::string;
+using std::vector;
+
+/**
+ * @brief Thrown when a form uses something the compiler cannot translate
+ */
+struct Unsupported : std::runtime_error {
+    Unsupported(const string &what) : std::runtime_error(what) {}
+};
+
+/**
+ * @brief C++ class name of a primitive node, by arity kind and ExprType
+ */
+static const char *primitiveClass(ExprBase *e) {
+    static std::map<ExprType, const char *> unary = {
+        {E_CAR, "Car"}, {E_CDR, "Cdr"}, {E_NOT, "Not"},
+        {E_BOOLQ, "IsBoolean"}, {E_INTQ, "IsFixnum"}, {E_NULLQ, "IsNull"},
+        {E_PAIRQ, "IsPair"}, {E_PROCQ, "IsProcedure"}, {E_SYMBOLQ, "IsSymbol"},
+        {E_LISTQ, "IsList"}, {E_STRINGQ, "IsString"}, {E_DISPLAY, "Display"},
+        {E_RAISE, "Raise"}, {E_RAISE_CONTINUABLE, "RaiseContinuable"},
+        {E_ERRORQ, "IsErrorObject"}, {E_ERROR_MESSAGE, "ErrorObjectMessage"},
+        {E_ERROR_IRRITANTS, "ErrorObjectIrritants"},
+        {E_EXACT_INT_SQRT, "ExactIntSqrt"}, {E_PRIMEQ, "IsPrime"},
+    };
+    static std::map<ExprType, const char *> binary = {
+        {E_PLUS, "Plus"}, {E_MINUS, "Minus"}, {E_MUL, "Mult"}, {E_DIV, "Div"},
+        {E_MODULO, "Modulo"}, {E_EXPT, "Expt"}, {E_QUOTIENT, "Quotient"}, {E_REMAINDER, "Remainder"},
+        {E_LT, "Less"}, {E_LE, "LessEq"}, {E_EQ, "Equal"}, {E_GE, "GreaterEq"}, {E_GT, "Greater"},
+        {E_CONS, "Cons"}, {E_SETCAR, "SetCar"}, {E_SETCDR, "SetCdr"},
+        {E_MEMBER, "MemberFunc"}, {E_ASSOC, "AssocFunc"},
+        {E_EQQ, "IsEq"}, {E_EQVQ, "IsEqv"}, {E_EQUALQ, "IsEqual"}, {E_WITH_HANDLER, "WithHandler"},
+        {E_MAP, "Map"}, {E_FILTER, "Filter"},
+    };
+    static std::map<ExprType, const char *> variadic = {
+        {E_PLUS, "PlusVar"}, {E_MINUS, "MinusVar"}, {E_MUL, "MultVar"}, {E_DIV, "DivVar"},
+        {E_LT, "LessVar"}, {E_LE, "LessEqVar"}, {E_EQ, "EqualVar"}, {E_GE, "GreaterEqVar"},
+        {E_GT, "GreaterVar"}, {E_LIST, "ListFunc"}, {E_ERROR, "ErrorFunc"},
+        {E_FOLD, "Fold"}, {E_GCD, "Gcd"}, {E_LCM, "Lcm"}, {E_EXPT_MOD, "ExptMod"},
+    };
+    std::map<ExprType, const char *> *table = nullptr;
+    if (dynamic_cast<Unary*>(e)) table = &unary;
+    else if (dynamic_cast<Binary*>(e)) table = &binary;
+    else if (dynamic_cast<Variadic*>(e)) table = &variadic;
+    if (table == nullptr) return nullptr;
+    auto it = table->find(e->e_type);
+    return it == table->end() ? nullptr : it->second;
+}
+
+static string quoteString(const string &s) {
+    std::ostringstream os;
+    os << '"';
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') os << '\\' << c;
+        else if (c >= 32 && c < 127) os << c;
+        else {
+            const char *digits = "01234567";
+            os << '\\' << digits[(c >> 6) & 7] << digits[(c >> 3) & 7] << digits[c & 7];
+        }
+    }
+    os << '"';
+    return os.str();
+}
+
+/**
+ * @brief Calls f on each direct subexpression of e
+ */
+template <typename F>
+static void forEachChild(ExprBase *e, F f) {
+    if (Unary *u = dynamic_cast<Unary*>(e)) { f(u->rand.get()); return; }
+    if (Binary *b = dynamic_cast<Binary*>(e)) { f(b->rand1.get()); f(b->rand2.get()); return; }
+    if (Variadic *v = dynamic_cast<Variadic*>(e)) { for (auto &x : v->rands) f(x.get()); return; }
+    switch (e->e_type) {
+        case E_AND: for (auto &x : static_cast<AndVar*>(e)->rands) f(x.get()); return;
+        case E_OR: for (auto &x : static_cast<OrVar*>(e)->rands) f(x.get()); return;
+        case E_BEGIN: for (auto &x : static_cast<Begin*>(e)->es) f(x.get()); return;
+        case E_IF: {
+            If *i = static_cast<If*>(e);
+            f(i->cond.get()); f(i->conseq.get()); f(i->alter.get());
+            return;
+        }
+        case E_COND:
+            for (auto &cl : static_cast<Cond*>(e)->clauses) for (auto &x : cl) f(x.get());
+            return;
+        case E_CASE: {
+            Case *c = static_cast<Case*>(e);
+            f(c->key.get());
+            for (auto &x : c->bodies) f(x.get());
+            return;
+        }
+        case E_APPLY: {
+            Apply *a = static_cast<Apply*>(e);
+            f(a->rator.get());
+            for (auto &x : a->rand) f(x.get());
+            return;
+        }
+        case E_LAMBDA: f(static_cast<Lambda*>(e)->e.get()); return;
+        case E_DEFINE: f(static_cast<Define*>(e)->e.get()); return;
+        case E_SET: f(static_cast<Set*>(e)->e.get()); return;
+        case E_LET: {
+            Let *l = static_cast<Let*>(e);
+            for (auto &b : l->bind) f(b.second.get());
+            f(l->body.get());
+            return;
+        }
+        case E_LETREC: {
+            Letrec *l = static_cast<Letrec*>(e);
+            for (auto &b : l->bind) f(b.second.get());
+            f(l->body.get());
+            return;
+        }
+        default:
+            return;
+    }
+}
+
+/**
+ * @brief A top-level procedure that can be called directly
+ */
+struct KnownProc {
+    string fn;          ///< C++ function implementing the body
+    string slot;        ///< Static Value holding the procedure once defined
+    size_t arity;
+    size_t form;        ///< Index of the defining top-level form
+};
+
+class Emitter {
+    std::ostringstream decls;     // static nodes and forward declarations
+    std::ostringstream funcs;     // function definitions
+    int next_id;
+    size_t form_index;
+    std::map<string, int> defines;        // top-level define count per name
+    std::set<string> assigned;            // every set! target
+    std::map<string, KnownProc> known;
+
+    string fresh(const string &prefix) {
+        return prefix + std::to_string(next_id++);
+    }
+
+    static void indent(std::ostream &out, int depth) {
+        for (int i = 0; i < depth; ++i) out << "    ";
+    }
+
+    // ------------------------------------------------------------------
+    // Whole-program facts
+    // ------------------------------------------------------------------
+
+    void collectAssigned(ExprBase *e) {
+        if (e->e_type == E_SET) assigned.insert(static_cast<Set*>(e)->var);
+        forEachChild(e, [this](ExprBase *c) { collectAssigned(c); });
+    }
+
+    void collectTopDefines(ExprBase *e) {
+        if (e->e_type == E_DEFINE) {
+            ++defines[static_cast<Define*>(e)->var];
+        } else if (e->e_type == E_BEGIN) {
+            for (auto &x : static_cast<Begin*>(e)->es) collectTopDefines(x.get());
+        }
+    }
+
+    // Names defined inside a body, outside nested lambdas
+    static void collectInnerDefines(ExprBase *e, vector<string> &out) {
+        if (e->e_type == E_DEFINE) out.push_back(static_cast<Define*>(e)->var);
+        if (e->e_type == E_LAMBDA) return;
+        forEachChild(e, [&out](ExprBase *c) { collectInnerDefines(c, out); });
+    }
+
+    // ------------------------------------------------------------------
+    // Unboxed fixnum expressions
+    // ------------------------------------------------------------------
+
+    bool provenFixnum(ExprBase *e) {
+        if (e->e_type == E_FIXNUM) return true;
+        if (e->e_type == E_PLUS || e->e_type == E_MINUS || e->e_type == E_MUL) {
+            Binary *b = dynamic_cast<Binary*>(e);
+            return b && provenFixnum(b->rand1.get()) && provenFixnum(b->rand2.get());
+        }
+        return false;
+    }
+
+    // C++ int expression for a proven fixnum tree; wraps like the interpreter
+    string unboxed(ExprBase *e) {
+        if (e->e_type == E_FIXNUM) return "(" + std::to_string(static_cast<Fixnum*>(e)->n) + ")";
+        Binary *b = static_cast<Binary*>(e);
+        const char *op = e->e_type == E_PLUS ? " + " : e->e_type == E_MINUS ? " - " : " * ";
+        return "(int)((unsigned)" + unboxed(b->rand1.get()) + op + "(unsigned)" + unboxed(b->rand2.get()) + ")";
+    }
+
+    // ------------------------------------------------------------------
+    // Code generation
+    // ------------------------------------------------------------------
+
+    string quoteValue(SyntaxBase *s) {
+        if (Number *n = dynamic_cast<Number*>(s)) return "IntegerV(" + std::to_string(n->n) + ")";
+        if (RationalSyntax *r = dynamic_cast<RationalSyntax*>(s))
+            return "RationalV(" + std::to_string(r->numerator) + ", " + std::to_string(r->denominator) + ")";
+        if (dynamic_cast<TrueSyntax*>(s)) return "BooleanV(true)";
+        if (dynamic_cast<FalseSyntax*>(s)) return "BooleanV(false)";
+        if (StringSyntax *str = dynamic_cast<StringSyntax*>(s)) return "StringV(" + quoteString(str->s) + ")";
+        if (SymbolSyntax *sym = dynamic_cast<SymbolSyntax*>(s)) return "SymbolV(" + quoteString(sym->s) + ")";
+        if (List *lst = dynamic_cast<List*>(s)) {
+            string v = "NullV()";
+            for (int i = (int)lst->stxs.size() - 1; i >= 0; --i)
+                v = "PairV(" + quoteValue(lst->stxs[i].get()) + ", " + v + ")";
+            return v;
+        }
+        throw Unsupported("quoted datum");
+    }
+
+    bool inScope(const vector<string> &scope, const string &x) {
+        for (auto &s : scope) if (s == x) return true;
+        return false;
+    }
+
+    // Emit statements computing e under the Assoc named env; returns the Value temp
+    string gen(ExprBase *e, std::ostream &out, const string &env, vector<string> &scope, int d) {
+        string t = fresh("t");
+        if (provenFixnum(e)) {
+            indent(out, d); out << "Value " << t << " = IntegerV(" << unboxed(e) << ");\n";
+            return t;
+        }
+        if (const char *cls = primitiveClass(e)) {
+            string node = fresh("prim");
+            vector<string> args;
+            if (Unary *u = dynamic_cast<Unary*>(e)) {
+                decls << "static " << cls << " " << node << "(Expr(nullptr));\n";
+                args.push_back(gen(u->rand.get(), out, env, scope, d));
+            } else if (Binary *b = dynamic_cast<Binary*>(e)) {
+                if (provenFixnum(b->rand1.get()) && provenFixnum(b->rand2.get())) {
+                    const char *cmp = e->e_type == E_LT ? " < " : e->e_type == E_LE ? " <= " :
+                                      e->e_type == E_EQ ? " == " : e->e_type == E_GE ? " >= " :
+                                      e->e_type == E_GT ? " > " : nullptr;
+                    if (cmp) {
+                        indent(out, d);
+                        out << "Value " << t << " = BooleanV(" << unboxed(b->rand1.get()) << cmp
+                            << unboxed(b->rand2.get()) << ");\n";
+                        return t;
+                    }
+                }
+                decls << "static " << cls << " " << node << "(Expr(nullptr), Expr(nullptr));\n";
+                string r2 = gen(b->rand2.get(), out, env, scope, d);
+                string r1 = gen(b->rand1.get(), out, env, scope, d);
+                args.push_back(r1);
+                args.push_back(r2);
+            } else {
+                Variadic *v = static_cast<Variadic*>(e);
+                decls << "static " << cls << " " << node << "(std::vector<Expr>{});\n";
+                for (auto &x : v->rands) args.push_back(gen(x.get(), out, env, scope, d));
+            }
+            indent(out, d); out << "Value " << t << " = " << node << ".evalRator(";
+            if (dynamic_cast<Variadic*>(e)) out << "std::vector<Value>{";
+            for (size_t i = 0; i < args.size(); ++i) out << (i ? ", " : "") << args[i];
+            if (dynamic_cast<Variadic*>(e)) out << "}";
+            out << ");\n";
+            return t;
+        }
+        switch (e->e_type) {
+            case E_FIXNUM:
+                break;  // handled as a proven fixnum
+            case E_RATIONAL: {
+                RationalNum *r = static_cast<RationalNum*>(e);
+                indent(out, d);
+                out << "Value " << t << " = RationalV(" << r->numerator << ", " << r->denominator << ");\n";
+                return t;
+            }
+            case E_STRING:
+                indent(out, d);
+                out << "Value " << t << " = StringV(" << quoteString(static_cast<StringExpr*>(e)->s) << ");\n";
+                return t;
+            case E_TRUE:
+            case E_FALSE:
+                indent(out, d);
+                out << "Value " << t << " = BooleanV(" << (e->e_type == E_TRUE ? "true" : "false") << ");\n";
+                return t;
+            case E_VOID:
+                indent(out, d); out << "Value " << t << " = VoidV();\n";
+                return t;
+            case E_EXIT:
+                indent(out, d); out << "Value " << t << " = TerminateV();\n";
+                return t;
+            case E_CHECKPOINT: {
+                string node = fresh("prim");
+                decls << "static MakeCheckpoint " << node << ";\n";
+                indent(out, d); out << "Value " << t << " = " << node << ".eval(" << env << ");\n";
+                return t;
+            }
+            case E_QUOTE:
+                indent(out, d);
+                out << "Value " << t << " = " << quoteValue(static_cast<Quote*>(e)->s.get()) << ";\n";
+                return t;
+            case E_VAR: {
+                string node = fresh("var");
+                decls << "static Var " << node << "(" << quoteString(static_cast<Var*>(e)->x) << ");\n";
+                indent(out, d); out << "Value " << t << " = " << node << ".eval(" << env << ");\n";
+                return t;
+            }
+            case E_AND:
+            case E_OR: {
+                vector<Expr> &rands = e->e_type == E_AND ? static_cast<AndVar*>(e)->rands
+                                                         : static_cast<OrVar*>(e)->rands;
+                indent(out, d);
+                out << "Value " << t << " = BooleanV(" << (e->e_type == E_AND ? "true" : "false") << ");\n";
+                indent(out, d); out << "do {\n";
+                for (auto &x : rands) {
+                    string r = gen(x.get(), out, env, scope, d + 1);
+                    indent(out, d + 1); out << t << " = " << r << ";\n";
+                    indent(out, d + 1);
+                    out << "if (" << (e->e_type == E_AND ? "!" : "") << "aotTruthy(" << t << ")) break;\n";
+                }
+                indent(out, d); out << "} while (false);\n";
+                return t;
+            }
+            case E_BEGIN: {
+                indent(out, d); out << "Value " << t << " = VoidV();\n";
+                for (auto &x : static_cast<Begin*>(e)->es) {
+                    string r = gen(x.get(), out, env, scope, d);
+                    indent(out, d); out << t << " = " << r << ";\n";
+                }
+                return t;
+            }
+            case E_IF: {
+                If *i = static_cast<If*>(e);
+                string c = gen(i->cond.get(), out, env, scope, d);
+                indent(out, d); out << "Value " << t << "(nullptr);\n";
+                indent(out, d); out << "if (aotTruthy(" << c << ")) {\n";
+                string a = gen(i->conseq.get(), out, env, scope, d + 1);
+                indent(out, d + 1); out << t << " = " << a << ";\n";
+                indent(out, d); out << "} else {\n";
+                string b = gen(i->alter.get(), out, env, scope, d + 1);
+                indent(out, d + 1); out << t << " = " << b << ";\n";
+                indent(out, d); out << "}\n";
+                return t;
+            }
+            case E_COND: {
+                // Standard cond: first true test wins; a test-only clause yields the test
+                indent(out, d); out << "Value " << t << " = VoidV();\n";
+                indent(out, d); out << "do {\n";
+                for (auto &clause : static_cast<Cond*>(e)->clauses) {
+                    Var *head = dynamic_cast<Var*>(clause[0].get());
+                    string c;
+                    if (head && head->x == "else" && !inScope(scope, "else")) {
+                        c = fresh("t");
+                        indent(out, d + 1); out << "Value " << c << " = BooleanV(true);\n";
+                    } else {
+                        c = gen(clause[0].get(), out, env, scope, d + 1);
+                    }
+                    indent(out, d + 1); out << "if (aotTruthy(" << c << ")) {\n";
+                    indent(out, d + 2); out << t << " = " << c << ";\n";
+                    for (size_t k = 1; k < clause.size(); ++k) {
+                        string r = gen(clause[k].get(), out, env, scope, d + 2);
+                        indent(out, d + 2); out << t << " = " << r << ";\n";
+                    }
+                    indent(out, d + 2); out << "break;\n";
+                    indent(out, d + 1); out << "}\n";
+                }
+                indent(out, d); out << "} while (false);\n";
+                return t;
+            }
+            case E_CASE: {
+                Case *c = static_cast<Case*>(e);
+                string key = fresh("key");
+                string k = gen(c->key.get(), out, env, scope, d);
+                indent(out, d); out << "Value " << key << " = " << k << ";\n";
+                // A whole rational dispatches as the fixnum it equals
+                indent(out, d);
+                out << "if (" << key << "->v_type == V_RATIONAL && static_cast<Rational*>(" << key
+                    << ".get())->denominator == 1)\n";
+                indent(out, d + 1);
+                out << key << " = IntegerV(static_cast<Rational*>(" << key << ".get())->numerator);\n";
+                string sel = fresh("sel");
+                indent(out, d); out << "int " << sel << " = -1;\n";
+                indent(out, d); out << "switch (" << key << "->v_type) {\n";
+                indent(out, d); out << "case V_INT:\n";
+                indent(out, d + 1);
+                out << "switch (static_cast<Integer*>(" << key << ".get())->n) {\n";
+                for (auto &kv : c->fixnums) {
+                    indent(out, d + 1);
+                    out << "case " << kv.first << ": " << sel << " = " << kv.second << "; break;\n";
+                }
+                indent(out, d + 1); out << "}\n";
+                indent(out, d + 1); out << "break;\n";
+                indent(out, d); out << "case V_RATIONAL: {\n";
+                indent(out, d + 1);
+                out << "Rational *r = static_cast<Rational*>(" << key << ".get());\n";
+                for (auto &kv : c->rationals) {
+                    indent(out, d + 1);
+                    out << "if (r->numerator == " << kv.first.first << " && r->denominator == "
+                        << kv.first.second << ") " << sel << " = " << kv.second << ";\n";
+                }
+                indent(out, d + 1); out << "break;\n";
+                indent(out, d); out << "}\n";
+                indent(out, d); out << "case V_SYM: {\n";
+                indent(out, d + 1);
+                out << "const std::string &s = static_cast<Symbol*>(" << key << ".get())->s;\n";
+                // Clause order does not matter: each symbol maps to one clause
+                for (auto &kv : c->symbols) {
+                    indent(out, d + 1);
+                    out << "if (s == " << quoteString(kv.first) << ") " << sel << " = " << kv.second << ";\n";
+                }
+                indent(out, d + 1); out << "break;\n";
+                indent(out, d); out << "}\n";
+                indent(out, d); out << "case V_BOOL:\n";
+                indent(out, d + 1);
+                out << sel << " = static_cast<Boolean*>(" << key << ".get())->b ? "
+                    << c->booleans[1] << " : " << c->booleans[0] << ";\n";
+                indent(out, d + 1); out << "break;\n";
+                indent(out, d); out << "case V_NULL:\n";
+                indent(out, d + 1); out << sel << " = " << c->null_clause << ";\n";
+                indent(out, d + 1); out << "break;\n";
+                indent(out, d); out << "default:\n";
+                indent(out, d + 1); out << "break;\n";
+                indent(out, d); out << "}\n";
+                indent(out, d); out << "if (" << sel << " < 0) " << sel << " = " << c->else_clause << ";\n";
+                indent(out, d); out << "Value " << t << " = VoidV();\n";
+                indent(out, d); out << "switch (" << sel << ") {\n";
+                for (size_t k = 0; k < c->bodies.size(); ++k) {
+                    indent(out, d); out << "case " << k << ": {\n";
+                    string r = gen(c->bodies[k].get(), out, env, scope, d + 1);
+                    indent(out, d + 1);
+                    if (c->receivers[k])
+                        out << t << " = applyProcedure(" << r << ", std::vector<Value>(1, " << key << "));\n";
+                    else
+                        out << t << " = " << r << ";\n";
+                    indent(out, d + 1); out << "break;\n";
+                    indent(out, d); out << "}\n";
+                }
+                indent(out, d); out << "}\n";
+                return t;
+            }
+            case E_LAMBDA: {
+                Lambda *l = static_cast<Lambda*>(e);
+                string fn = genLambda(l, scope);
+                string code = fresh("code");
+                decls << "static const CodeRef " << code << " = std::make_shared<ProcedureCode>(std::vector<std::string>{";
+                for (size_t i = 0; i < l->x.size(); ++i) decls << (i ? ", " : "") << quoteString(l->x[i]);
+                decls << "}, Expr(new NativeCode(&" << fn << ")));\n";
+                indent(out, d);
+                out << "Value " << t << " = ProcedureV(" << code << ", " << env << ");\n";
+                return t;
+            }
+            case E_APPLY:
+                return genApply(static_cast<Apply*>(e), out, env, scope, d);
+            case E_DEFINE: {
+                Define *def = static_cast<Define*>(e);
+                string v = gen(def->e.get(), out, env, scope, d);
+                string name = quoteString(def->var);
+                indent(out, d); out << "if (find(" << name << ", " << env << ").get() != nullptr) {\n";
+                indent(out, d + 1); out << "modify(" << name << ", " << v << ", " << env << ");\n";
+                indent(out, d); out << "} else {\n";
+                indent(out, d + 1); out << env << " = extend(" << name << ", " << v << ", " << env << ");\n";
+                indent(out, d); out << "}\n";
+                if (scope.empty() && def->e->e_type == E_LAMBDA && defines[def->var] == 1 &&
+                    assigned.count(def->var) == 0) {
+                    KnownProc &k = known[def->var];
+                    k.slot = fresh("known");
+                    k.fn = last_lambda;
+                    k.arity = static_cast<Lambda*>(def->e.get())->x.size();
+                    k.form = form_index;
+                    decls << "static Value " << k.slot << "(nullptr);\n";
+                    indent(out, d); out << k.slot << " = " << v << ";\n";
+                }
+                indent(out, d); out << "Value " << t << " = " << v << ";\n";
+                return t;
+            }
+            case E_LET: {
+                Let *l = static_cast<Let*>(e);
+                string local = fresh("env");
+                indent(out, d); out << "Assoc " << local << " = " << env << ";\n";
+                for (auto &b : l->bind) {
+                    string v = gen(b.second.get(), out, env, scope, d);
+                    indent(out, d);
+                    out << local << " = extend(" << quoteString(b.first) << ", " << v << ", " << local << ");\n";
+                }
+                size_t mark = scope.size();
+                for (auto &b : l->bind) scope.push_back(b.first);
+                string r = gen(l->body.get(), out, local, scope, d);
+                scope.resize(mark);
+                return r;
+            }
+            case E_LETREC: {
+                Letrec *l = static_cast<Letrec*>(e);
+                string local = fresh("env");
+                indent(out, d); out << "Assoc " << local << " = " << env << ";\n";
+                for (auto &b : l->bind) {
+                    indent(out, d);
+                    out << local << " = extend(" << quoteString(b.first) << ", Value(nullptr), " << local << ");\n";
+                }
+                size_t mark = scope.size();
+                for (auto &b : l->bind) scope.push_back(b.first);
+                vector<string> vals;
+                for (auto &b : l->bind) vals.push_back(gen(b.second.get(), out, local, scope, d));
+                for (size_t i = 0; i < vals.size(); ++i) {
+                    indent(out, d);
+                    out << "modify(" << quoteString(l->bind[i].first) << ", " << vals[i] << ", " << local << ");\n";
+                }
+                string r = gen(l->body.get(), out, local, scope, d);
+                scope.resize(mark);
+                return r;
+            }
+            case E_SET: {
+                Set *s = static_cast<Set*>(e);
+                string v = gen(s->e.get(), out, env, scope, d);
+                indent(out, d); out << "modify(" << quoteString(s->var) << ", " << v << ", " << env << ");\n";
+                return v;
+            }
+            default:
+                break;
+        }
+        throw Unsupported("expression type " + std::to_string((int)e->e_type));
+    }
+
+    string genApply(Apply *a, std::ostream &out, const string &env, vector<string> &scope, int d) {
+        string proc = fresh("t");
+        const KnownProc *k = nullptr;
+        Var *rator = dynamic_cast<Var*>(a->rator.get());
+        if (rator && !inScope(scope, rator->x)) {
+            auto it = known.find(rator->x);
+            // Closures created by earlier forms cannot see the binding yet
+            if (it != known.end() && it->second.form < form_index && it->second.arity == a->rand.size())
+                k = &it->second;
+        }
+        if (k) {
+            indent(out, d); out << "Value " << proc << " = " << k->slot << ";\n";
+            indent(out, d); out << "if (" << proc << ".get() == nullptr) {\n";
+            string looked = gen(a->rator.get(), out, env, scope, d + 1);
+            indent(out, d + 1); out << proc << " = " << looked << ";\n";
+            indent(out, d); out << "}\n";
+        } else {
+            string r = gen(a->rator.get(), out, env, scope, d);
+            indent(out, d); out << "Value " << proc << " = " << r << ";\n";
+        }
+        indent(out, d);
+        out << "if (" << proc << ".get() == nullptr) throw RuntimeError(\"Unbound variable\");\n";
+        indent(out, d);
+        out << "if (" << proc << "->v_type != V_PROC) throw RuntimeError(\"Attempt to apply a non-procedure\");\n";
+        vector<string> args;
+        for (auto &x : a->rand) args.push_back(gen(x.get(), out, env, scope, d));
+
+        string t = fresh("t");
+        indent(out, d); out << "Value " << t << "(nullptr);\n";
+        if (k) {
+            string call_env = fresh("env");
+            indent(out, d); out << "if (" << proc << ".get() == " << k->slot << ".get()) {\n";
+            indent(out, d + 1);
+            out << "Assoc " << call_env << " = static_cast<Procedure*>(" << proc << ".get())->env;\n";
+            Lambda *l = known_lambdas[k->fn];
+            for (size_t i = 0; i < args.size(); ++i) {
+                indent(out, d + 1);
+                out << call_env << " = extend(" << quoteString(l->x[i]) << ", " << args[i] << ", " << call_env << ");\n";
+            }
+            indent(out, d + 1); out << t << " = " << k->fn << "(" << call_env << ");\n";
+            indent(out, d); out << "} else {\n";
+            indent(out, d + 1);
+        } else {
+            indent(out, d);
+        }
+        out << t << " = applyProcedure(" << proc << ", std::vector<Value>{";
+        for (size_t i = 0; i < args.size(); ++i) out << (i ? ", " : "") << args[i];
+        out << "});\n";
+        if (k) {
+            indent(out, d); out << "}\n";
+        }
+        return t;
+    }
+
+    string last_lambda;
+    std::map<string, Lambda*> known_lambdas;
+
+    string genLambda(Lambda *l, const vector<string> &outer) {
+        string fn = fresh("lambda");
+        vector<string> scope = outer;
+        for (auto &p : l->x) scope.push_back(p);
+        vector<string> inner;
+        collectInnerDefines(l->e.get(), inner);
+        for (auto &x : inner) scope.push_back(x);
+        // Keep scope non-empty inside lambdas so defines there are not top-level
+        scope.push_back("");
+
+        std::ostringstream body;
+        string r = gen(l->e.get(), body, "env", scope, 1);
+        decls << "static Value " << fn << "(Assoc &env);\n";
+        funcs << "static Value " << fn << "(Assoc &env) {\n" << body.str() << "    return " << r << ";\n}\n\n";
+        last_lambda = fn;
+        known_lambdas[fn] = l;
+        return fn;
+    }
+
+public:
+    Emitter() : next_id(0), form_index(0) {}
+
+    void analyze(const vector<Expr> &forms) {
+        for (auto &f : forms) {
+            if (f.get() == nullptr) continue;
+            collectAssigned(f.get());
+            collectTopDefines(f.get());
+        }
+    }
+
+    // Emit one top-level form; a null expr means it failed to parse
+    string genForm(ExprBase *e, const string &parse_error) {
+        string fn = fresh("form");
+        std::ostringstream body;
+        if (e == nullptr) {
+            body << "    throw RuntimeError(" << quoteString(parse_error) << ");\n";
+        } else {
+            vector<string> scope;
+            string r = gen(e, body, "env", scope, 1);
+            body << "    return " << r << ";\n";
+        }
+        funcs << "static Value " << fn << "(Assoc &env) {\n" << body.str() << "}\n\n";
+        ++form_index;
+        return fn;
+    }
+
+    void write(std::ostream &os, const vector<string> &forms) {
+        os << "// Generated by scheme2cxx. Do not edit.\n"
+           << "#include \"aot.hpp\"\n"
+           << "#include <string>\n"
+           << "#include <vector>\n\n"
+           << decls.str() << "\n"
+           << funcs.str()
+           << "int main() {\n"
+           << "    Assoc env = empty();\n";
+        for (auto &f : forms) os << "    if (!aotRunForm(&" << f << ", env)) return 0;\n";
+        os << "    return 0;\n"
+           << "}\n";
+    }
+};
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        std::cerr << "usage: scheme2cxx input.scm output.cpp" << std::endl;
+        return 2;
+    }
+    std::ifstream in(argv[1]);
+    if (!in) {
+        std::cerr << "scheme2cxx: cannot open " << argv[1] << std::endl;
+        return 1;
+    }
+
+    // Parse every form against the names earlier top-level defines bind,
+    // as the REPL would see them. Bodies are translated too, so all of them
+    // are parsed now.
+    lazy_lambda_bodies = false;
+    vector<Expr> exprs;
+    vector<string> errors;
+    Assoc env = empty();
+    while (readSpace(in).peek() != EOF) {
+        Syntax stx = readSyntax(in);
+        try {
+            Expr e = stx->parse(env);
+            exprs.push_back(e);
+            errors.push_back("");
+            vector<ExprBase*> pending(1, e.get());
+            while (!pending.empty()) {
+                ExprBase *x = pending.back();
+                pending.pop_back();
+                if (x->e_type == E_DEFINE && find(static_cast<Define*>(x)->var, env).get() == nullptr)
+                    env = extend(static_cast<Define*>(x)->var, VoidV(), env);
+                if (x->e_type == E_BEGIN)
+                    for (auto &s : static_cast<Begin*>(x)->es) pending.push_back(s.get());
+            }
+        } catch (const RuntimeError &err) {
+            exprs.push_back(Expr(nullptr));
+            errors.push_back(err.message());
+        }
+    }
+
+    Emitter emitter;
+    emitter.analyze(exprs);
+    vector<string> forms;
+    try {
+        for (size_t i = 0; i < exprs.size(); ++i)
+            forms.push_back(emitter.genForm(exprs[i].get(), errors[i]));
+    } catch (const Unsupported &err) {
+        std::cerr << "scheme2cxx: unsupported " << err.what() << std::endl;
+        return 1;
+    }
+
+    std::ofstream out(argv[2]);
+    emitter.write(out, forms);
+    return out ? 0 : 1;
+}
@@ -0,0 +1,359 @@
+/**
+ * @file server.cpp
+ * @brief Implementation of the Unix domain socket evaluation server
+ *
+ * Connections are non-blocking and multiplexed with epoll. Requests are
+ * evaluated one at a time on the event loop thread, so the base environment
+ * and the undo journal never see concurrent access.
+ */
+
+#include "server.hpp"
+#include "syntax.hpp"
+#include "expr.hpp"
+#include "limits.hpp"
+#include "optimize.hpp"
+#include "RE.hpp"
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <cerrno>
+#include <cstdio>
+#include <csignal>
+#include <chrono>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+ServerOptions::ServerOptions() : fuel(-1), heap(0) {}
+
+/**
+ * @brief Redirects std::cout into a buffer for the lifetime of the object
+ */
+struct CoutCapture {
+    std::ostringstream buffer;
+    std::streambuf *saved;
+    CoutCapture() : saved(std::cout.rdbuf(buffer.rdbuf())) {}
+    ~CoutCapture() { std::cout.rdbuf(saved); }
+};
+
+std::string evalSource(std::istream &is, Assoc &env) {
+    CoutCapture capture;
+    while (readSpace(is).peek() != EOF) {
+        Syntax stx = readSyntax(is);
+        try {
+            Expr expr = stx->parse(env);
+            optimize(expr, env);
+            Value val = expr->eval(env);
+            if (val->v_type == V_TERMINATE)
+                break;
+            val->show(std::cout);
+        } catch (const RuntimeError &RE) {
+            std::cout << "RuntimeError";
+        } catch (const std::exception &) {
+            std::cout << "RuntimeError";
+        }
+        std::cout << '\n';
+    }
+    return capture.buffer.str();
+}
+
+std::string serveRequest(const std::string &src, Assoc &base, const ServerOptions &opts) {
+    Assoc env = base;
+    size_t checkpoints = checkpointCount();
+    size_t mark = journalBegin();
+    eval_fuel = opts.fuel;
+    heap_limit = opts.heap == 0 ? 0 : heap_live + opts.heap;
+    std::istringstream is(src);
+    std::string out = evalSource(is, env);
+    eval_fuel = -1;
+    heap_limit = 0;
+    checkpointDrop(checkpoints);
+    journalRollback(mark);
+    journalEnd();
+    dropLiftedProcedures();
+    drainReleases(0);
+    return out;
+}
+
+void loadPrelude(const ServerOptions &opts, Assoc &env) {
+    if (opts.prelude.empty()) return;
+    std::ifstream in(opts.prelude.c_str());
+    if (!in) throw std::runtime_error("cannot open prelude " + opts.prelude);
+    evalSource(in, env);
+}
+
+#ifdef __linux__
+
+/**
+ * @brief Per-connection buffers
+ */
+struct Connection {
+    std::string in;     ///< Request bytes received so far
+    std::string out;    ///< Response bytes not yet sent
+    bool replying;      ///< Request complete, response being written
+    Connection() : replying(false) {}
+};
+
+static void closeConnection(int epfd, int fd, std::map<int, Connection> &conns) {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    conns.erase(fd);
+}
+
+/**
+ * @brief Write as much pending output as the socket accepts
+ * @return false when the connection should be closed
+ */
+static bool flushConnection(int fd, Connection &conn) {
+    while (!conn.out.empty()) {
+        ssize_t n = send(fd, conn.out.data(), conn.out.size(), MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+            if (errno == EINTR) continue;
+            return false;
+        }
+        conn.out.erase(0, n);
+    }
+    return false;
+}
+
+/**
+ * @brief Drain readable bytes; once the client half-closes, evaluate the request
+ * @return false when the connection should be closed
+ */
+static bool readConnection(int epfd, int fd, Connection &conn,
+                           Assoc &base, const ServerOptions &opts) {
+    char buf[4096];
+    while (true) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n > 0) {
+            conn.in.append(buf, n);
+            continue;
+        }
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+            if (errno == EINTR) continue;
+            return false;
+        }
+        break;
+    }
+    conn.out = serveRequest(conn.in, base, opts);
+    conn.in.clear();
+    conn.replying = true;
+    epoll_event ev;
+    ev.events = EPOLLOUT;
+    ev.data.fd = fd;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+    return flushConnection(fd, conn);
+}
+
+/**
+ * @brief Create a listening, non-blocking Unix domain socket at path
+ * @return The socket, or -1 on failure
+ */
+static int listenUnix(const std::string &path) {
+    sockaddr_un addr;
+    if (path.size() >= sizeof(addr.sun_path)) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    addr.sun_family = AF_UNIX;
+    path.copy(addr.sun_path, path.size());
+    addr.sun_path[path.size()] = '\0';
+    unlink(path.c_str());
+    if (bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 128) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int runServer(const std::string &path, const ServerOptions &opts) {
+    signal(SIGPIPE, SIG_IGN);
+    Assoc base = empty();
+    try {
+        loadPrelude(opts, base);
+    } catch (const std::exception &ex) {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+
+    int lfd = listenUnix(path);
+    if (lfd < 0) {
+        perror("listen");
+        return 1;
+    }
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = lfd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, lfd, &ev);
+
+    std::map<int, Connection> conns;
+    epoll_event events[64];
+    while (true) {
+        int n = epoll_wait(epfd, events, 64, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == lfd) {
+                int cfd;
+                while ((cfd = accept4(lfd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                    epoll_event cev;
+                    cev.events = EPOLLIN | EPOLLRDHUP;
+                    cev.data.fd = cfd;
+                    epoll_ctl(epfd, EPOLL_CTL_ADD, cfd, &cev);
+                    conns[cfd] = Connection();
+                }
+                continue;
+            }
+            auto it = conns.find(fd);
+            if (it == conns.end()) continue;
+            bool keep;
+            if (events[i].events & EPOLLERR) {
+                keep = false;
+            } else if (it->second.replying) {
+                keep = flushConnection(fd, it->second);
+            } else {
+                keep = readConnection(epfd, fd, it->second, base, opts);
+            }
+            if (!keep) closeConnection(epfd, fd, conns);
+        }
+    }
+    close(epfd);
+    close(lfd);
+    unlink(path.c_str());
+    return 1;
+}
+
+/**
+ * @brief Page counts of the calling process, from /proc/self/smaps_rollup
+ */
+struct PageUsage {
+    long shared;
+    long priv;
+};
+
+static PageUsage readPageUsage() {
+    PageUsage usage = {-1, -1};
+    std::ifstream in("/proc/self/smaps_rollup");
+    if (!in) return usage;
+    long page_kb = sysconf(_SC_PAGESIZE) / 1024;
+    long shared_kb = 0, private_kb = 0;
+    std::string key;
+    long kb;
+    while (in >> key) {
+        if (!(in >> kb)) {
+            in.clear();
+            in.ignore(1 << 20, '\n');
+            continue;
+        }
+        if (key == "Shared_Clean:" || key == "Shared_Dirty:") shared_kb += kb;
+        else if (key == "Private_Clean:" || key == "Private_Dirty:") private_kb += kb;
+        in.ignore(1 << 20, '\n');
+    }
+    usage.shared = shared_kb / page_kb;
+    usage.priv = private_kb / page_kb;
+    return usage;
+}
+
+/**
+ * @brief Serve one connection in a forked child and exit without teardown
+ */
+static void serveForked(int fd, Assoc &base, const ServerOptions &opts,
+                        std::chrono::steady_clock::time_point forked_at) {
+    long fork_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - forked_at).count();
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    std::string in;
+    char buf[4096];
+    ssize_t n;
+    while ((n = recv(fd, buf, sizeof(buf), 0)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            _exit(1);
+        }
+        in.append(buf, n);
+    }
+    std::string out = serveRequest(in, base, opts);
+    for (size_t sent = 0; sent < out.size(); ) {
+        n = send(fd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        sent += n;
+    }
+    close(fd);
+    PageUsage pages = readPageUsage();
+    std::cerr << "fork-server: pid " << getpid()
+              << " fork " << fork_us << "us"
+              << " shared " << pages.shared << " pages"
+              << " private " << pages.priv << " pages" << std::endl;
+    // Skip destructors: releasing the inherited heap would dirty shared pages.
+    _exit(0);
+}
+
+int runForkServer(const std::string &path, const ServerOptions &opts) {
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGCHLD, SIG_IGN);
+    Assoc base = empty();
+    try {
+        loadPrelude(opts, base);
+    } catch (const std::exception &ex) {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+    freezeEnv(base);
+
+    int lfd = listenUnix(path);
+    if (lfd < 0) {
+        perror("listen");
+        return 1;
+    }
+    fcntl(lfd, F_SETFL, fcntl(lfd, F_GETFL) & ~O_NONBLOCK);
+    std::cout.flush();
+    while (true) {
+        int cfd = accept4(lfd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (cfd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            perror("accept");
+            break;
+        }
+        std::chrono::steady_clock::time_point forked_at = std::chrono::steady_clock::now();
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(lfd);
+            serveForked(cfd, base, opts, forked_at);
+        }
+        if (pid < 0) perror("fork");
+        close(cfd);
+    }
+    close(lfd);
+    unlink(path.c_str());
+    return 1;
+}
+
+#else
+
+int runServer(const std::string &path, const ServerOptions &opts) {
+    std::cerr << "server mode requires Linux" << std::endl;
+    return 1;
+}
+
+int runForkServer(const std::string &path, const ServerOptions &opts) {
+    std::cerr << "fork-server mode requires Linux" << std::endl;
+    return 1;
+}
+
+#endif
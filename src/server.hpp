@@ -0,0 +1,64 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+/**
+ * @file server.hpp
+ * @brief Persistent evaluation server over a Unix domain socket
+ *
+ * The server loads an optional prelude into a base environment once and then
+ * answers requests on a Unix domain socket. A request is the Scheme source a
+ * client writes before shutting down its write side; the response is the text
+ * the REPL would have printed for it (one line per form, with `display`
+ * output interleaved). Each request runs in a child of the base environment,
+ * and every mutation it makes to shared bindings or pairs is rolled back when
+ * it finishes.
+ *
+ * In fork-server (zygote) mode the prelude is loaded and frozen once, and a
+ * child is fork()ed per connection. Children inherit the warm heap through
+ * copy-on-write and exit without tearing it down; each child logs its fork
+ * latency and its shared and private page counts to stderr.
+ */
+
+#include "Def.hpp"
+#include "value.hpp"
+#include <string>
+#include <istream>
+
+/**
+ * @brief Options controlling the server and its per-request limits
+ */
+struct ServerOptions {
+    std::string prelude;   ///< Prelude file loaded into the base environment
+    long fuel;             ///< Procedure applications per request, negative if unlimited
+    size_t heap;           ///< Live values allowed per request, 0 if unlimited
+    ServerOptions();
+};
+
+/**
+ * @brief Evaluate every form in the stream under env, returning the printed output
+ */
+std::string evalSource(std::istream &, Assoc &);
+
+/**
+ * @brief Evaluate a request in a child of the base environment under the limits
+ */
+std::string serveRequest(const std::string &, Assoc &, const ServerOptions &);
+
+/**
+ * @brief Load the prelude named in the options into env
+ */
+void loadPrelude(const ServerOptions &, Assoc &);
+
+/**
+ * @brief Run the epoll-driven server on the given socket path
+ * @return Process exit status
+ */
+int runServer(const std::string &, const ServerOptions &);
+
+/**
+ * @brief Run the fork-per-request zygote server on the given socket path
+ * @return Process exit status
+ */
+int runForkServer(const std::string &, const ServerOptions &);
+
+#endif // SERVER_HPP
@@ -0,0 +1,20 @@
+/**
+ * @file stats.cpp
+ * @brief Storage and reporting of interpreter counters
+ */
+
+#include "stats.hpp"
+
+InterpreterStats::InterpreterStats() : call_hits(0), call_misses(0), megamorphic(0) {}
+
+InterpreterStats interp_stats;
+
+void printStats(std::ostream &os) {
+    unsigned long calls = interp_stats.call_hits + interp_stats.call_misses;
+    os << "call sites: " << calls << " generic calls, "
+       << interp_stats.call_hits << " inline cache hits, "
+       << interp_stats.call_misses << " misses ("
+       << interp_stats.megamorphic << " megamorphic)\n";
+    for (auto &site : interp_stats.megamorphic_sites)
+        os << "  megamorphic: " << site.first << " " << site.second << " misses\n";
+}
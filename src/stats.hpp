@@ -0,0 +1,34 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+/**
+ * @file stats.hpp
+ * @brief Counters collected while the interpreter runs
+ *
+ * Counting is always on and costs one increment per event. `code --stats`
+ * prints the counters to stderr when the REPL exits.
+ */
+
+#include <map>
+#include <ostream>
+#include <string>
+
+/**
+ * @brief Interpreter-wide counters
+ */
+struct InterpreterStats {
+    unsigned long call_hits;        ///< Apply inline cache hits
+    unsigned long call_misses;      ///< Apply inline cache misses
+    unsigned long megamorphic;      ///< Misses at sites whose cache was already full
+    std::map<std::string, unsigned long> megamorphic_sites;    ///< Operator -> megamorphic misses
+    InterpreterStats();
+};
+
+extern InterpreterStats interp_stats;
+
+/**
+ * @brief Print every counter in a human-readable form
+ */
+void printStats(std::ostream &);
+
+#endif // STATS_HPP
@@ -7,12 +7,27 @@
  */
 
 #include "value.hpp"
+#include "limits.hpp"
+#include "RE.hpp"
+#include "pool.hpp"
+#include "jit.hpp"
+#include <set>
+#include <unordered_map>
 
 // ============================================================================
 // Base ValueBase Implementation
 // ============================================================================
 
-ValueBase::ValueBase(ValueType vt) : v_type(vt) {}
+ValueBase::ValueBase(ValueType vt) : v_type(vt), frozen(false) {
+    if (++heap_live > heap_limit && heap_limit != 0) {
+        --heap_live;
+        throw RuntimeError("Heap limit exceeded");
+    }
+}
+
+ValueBase::~ValueBase() {
+    --heap_live;
+}
 
 void ValueBase::showCdr(std::ostream &os) {
     os << " . ";
@@ -26,6 +41,8 @@ void ValueBase::showCdr(std::ostream &os) {
 
 Value::Value(ValueBase *ptr) : ptr(ptr) {}
 
+Value::Value(const std::shared_ptr<ValueBase> &ptr) : ptr(ptr) {}
+
 ValueBase* Value::operator->() const { 
     return ptr.get(); 
 }
@@ -42,6 +59,67 @@ void Value::show(std::ostream &os) {
     ptr->show(os);
 }
 
+// ============================================================================
+// Deferred Release Implementation
+// ============================================================================
+
+size_t release_batch = 0;
+
+namespace {
+
+struct ReleaseQueue {
+    std::vector<std::shared_ptr<ValueBase>> values;
+    std::vector<std::shared_ptr<AssocList>> assocs;
+    bool draining;      ///< A drain loop is running further up the stack
+    bool skipped;       ///< skipTeardown() was called
+    ReleaseQueue() : draining(false), skipped(false) {}
+};
+
+// Allocated on first use and never destroyed, so values released during
+// static destruction still find it
+ReleaseQueue *releases = nullptr;
+
+ReleaseQueue &releaseQueue() {
+    if (releases == nullptr) releases = new ReleaseQueue;
+    return *releases;
+}
+
+}
+
+static void deferRelease(std::shared_ptr<ValueBase> &p) {
+    // Any other owner keeps the object alive; dropping ours cannot recurse
+    if (p.use_count() == 1) releaseQueue().values.push_back(std::move(p));
+}
+
+static void deferRelease(std::shared_ptr<AssocList> &p) {
+    if (p.use_count() == 1) releaseQueue().assocs.push_back(std::move(p));
+}
+
+size_t drainReleases(size_t limit) {
+    if (releases == nullptr || releases->draining || releases->skipped) return 0;
+    ReleaseQueue &q = *releases;
+    q.draining = true;
+    size_t n = 0;
+    for (; limit == 0 || n < limit; ++n) {
+        // Each destructor only queues its children, so the stack stays flat
+        if (!q.values.empty()) {
+            std::shared_ptr<ValueBase> last = std::move(q.values.back());
+            q.values.pop_back();
+        } else if (!q.assocs.empty()) {
+            std::shared_ptr<AssocList> last = std::move(q.assocs.back());
+            q.assocs.pop_back();
+        } else {
+            break;
+        }
+    }
+    q.draining = false;
+    return n;
+}
+
+void skipTeardown() {
+    releaseQueue().skipped = true;
+}
+
 // ============================================================================
 // Environment (Association List) Implementation
 // ============================================================================
@@ -49,8 +127,16 @@ void Value::show(std::ostream &os) {
 AssocList::AssocList(const std::string &x, const Value &v, Assoc &next)
     : x(x), v(v), next(next) {}
 
+AssocList::~AssocList() {
+    deferRelease(v.ptr);
+    deferRelease(next.ptr);
+    drainReleases(release_batch);
+}
+
 Assoc::Assoc(AssocList *x) : ptr(x) {}
 
+Assoc::Assoc(const std::shared_ptr<AssocList> &x) : ptr(x) {}
+
 AssocList* Assoc::operator->() const { 
     return ptr.get(); 
 }
@@ -68,13 +154,13 @@ Assoc empty() {
 }
 
 Assoc extend(const std::string &x, const Value &v, Assoc &lst) {
-    return Assoc(new AssocList(x, v, lst));
+    return Assoc(std::allocate_shared<AssocList>(PoolAllocator<AssocList>(), x, v, lst));
 }
 
 void modify(const std::string &x, const Value &v, Assoc &lst) {
     for (auto i = lst; i.get() != nullptr; i = i->next) {
         if (x == i->x) {
-            i->v = v;
+            journalWrite(i.ptr, i->v, v);
             return;
         }
     }
@@ -89,6 +175,144 @@ Value find(const std::string &x, Assoc &l) {
     return Value(nullptr);
 }
 
+// ============================================================================
+// Undo Journal Implementation
+// ============================================================================
+
+static std::vector<JournalEntry> journal;
+static size_t journal_depth = 0;
+
+/**
+ * @brief Open a journal scope and return its mark
+ */
+size_t journalBegin() {
+    ++journal_depth;
+    return journal.size();
+}
+
+/**
+ * @brief Undo every journaled write made after the mark, newest first
+ */
+void journalRollback(size_t mark) {
+    while (journal.size() > mark) {
+        JournalEntry &entry = journal.back();
+        *entry.slot = entry.old;
+        journal.pop_back();
+    }
+}
+
+/**
+ * @brief Close a journal scope; the log is discarded once no scope is open
+ */
+void journalEnd() {
+    if (journal_depth > 0) --journal_depth;
+    if (journal_depth == 0) journal.clear();
+}
+
+/**
+ * @brief Store a value into a mutable slot, logging the old value if journaling
+ */
+void journalWrite(const std::shared_ptr<void> &owner, Value &slot, const Value &v) {
+    if (journal_depth != 0) {
+        journal.push_back(JournalEntry{owner, &slot, slot});
+    }
+    slot = v;
+}
+
+static std::vector<JournalCheckpoint> checkpoints;
+
+unsigned env_epoch = 0;
+
+/**
+ * @brief Take a checkpoint of env and keep journaling until it is dropped
+ */
+size_t checkpointCreate(const Assoc &env) {
+    checkpoints.push_back(JournalCheckpoint{journalBegin(), env});
+    return checkpoints.size() - 1;
+}
+
+/**
+ * @brief Undo everything after checkpoint id, which stays valid, and return its head
+ */
+Assoc checkpointRestore(size_t id) {
+    ++env_epoch;
+    checkpointDrop(id + 1);
+    journalRollback(checkpoints[id].mark);
+    return checkpoints[id].env;
+}
+
+size_t checkpointCount() {
+    return checkpoints.size();
+}
+
+/**
+ * @brief Forget every checkpoint whose id is at least count
+ */
+void checkpointDrop(size_t count) {
+    while (checkpoints.size() > count) {
+        checkpoints.pop_back();
+        journalEnd();
+    }
+}
+
+// ============================================================================
+// Freezing Implementation
+// ============================================================================
+
+// Owning references to every frozen object. They are never released, so the
+// objects stay alive while all other handles to them are non-owning aliases.
+static std::vector<std::shared_ptr<void>> frozen_roots;
+
+/**
+ * @brief Make every value and binding reachable from env immortal
+ *
+ * Each handle reachable from env is replaced by an aliasing shared_ptr with no
+ * control block, so copying or dropping it never touches a reference count.
+ * After fork() the children can then use the frozen environment without
+ * writing to (and thereby privately copying) the pages that hold it.
+ */
+void freezeEnv(Assoc &env) {
+    std::vector<Value *> values;
+    std::vector<Assoc *> assocs;
+    std::set<AssocList *> seen;
+    assocs.push_back(&env);
+    while (!values.empty() || !assocs.empty()) {
+        if (!assocs.empty()) {
+            Assoc *a = assocs.back();
+            assocs.pop_back();
+            AssocList *node = a->get();
+            if (node == nullptr) continue;
+            if (seen.insert(node).second) {
+                frozen_roots.push_back(a->ptr);
+                values.push_back(&node->v);
+                assocs.push_back(&node->next);
+            }
+            a->ptr = std::shared_ptr<AssocList>(std::shared_ptr<AssocList>(), node);
+            continue;
+        }
+        Value *v = values.back();
+        values.pop_back();
+        ValueBase *obj = v->get();
+        if (obj == nullptr) continue;
+        if (!obj->frozen) {
+            obj->frozen = true;
+            frozen_roots.push_back(v->ptr);
+            if (obj->v_type == V_PAIR) {
+                Pair *p = static_cast<Pair *>(obj);
+                values.push_back(&p->car);
+                values.push_back(&p->cdr);
+            } else if (obj->v_type == V_PROC) {
+                assocs.push_back(&static_cast<Procedure *>(obj)->env);
+            } else if (obj->v_type == V_ERROR) {
+                values.push_back(&static_cast<ErrorObject *>(obj)->irritants);
+            } else if (obj->v_type == V_BOX) {
+                values.push_back(&static_cast<Box *>(obj)->content);
+            }
+        }
+        v->ptr = std::shared_ptr<ValueBase>(std::shared_ptr<ValueBase>(), obj);
+    }
+}
+
 // ============================================================================
 // Simple Value Types Implementation
 // ============================================================================
@@ -112,7 +336,7 @@ void Integer::show(std::ostream &os) {
 }
 
 Value IntegerV(int n) {
-    return Value(new Integer(n));
+    return Value(std::allocate_shared<Integer>(PoolAllocator<Integer>(), n));
 }
 
 // Rational
@@ -154,7 +378,7 @@ void Rational::show(std::ostream &os) {
 }
 
 Value RationalV(int num, int den) {
-    return Value(new Rational(num, den));
+    return Value(std::allocate_shared<Rational>(PoolAllocator<Rational>(), num, den));
 }
 
 // Boolean
@@ -165,7 +389,7 @@ void Boolean::show(std::ostream &os) {
 }
 
 Value BooleanV(bool b) {
-    return Value(new Boolean(b));
+    return Value(std::allocate_shared<Boolean>(PoolAllocator<Boolean>(), b));
 }
 
 // Symbol
@@ -228,6 +452,12 @@ Value TerminateV() {
 Pair::Pair(const Value &car, const Value &cdr) 
     : ValueBase(V_PAIR), car(car), cdr(cdr) {}
 
+Pair::~Pair() {
+    deferRelease(car.ptr);
+    deferRelease(cdr.ptr);
+    drainReleases(release_batch);
+}
+
 void Pair::show(std::ostream &os) {
     os << '(' << car;
     cdr->showCdr(os);
@@ -239,19 +469,152 @@ void Pair::showCdr(std::ostream &os) {
 }
 
 Value PairV(const Value &car, const Value &cdr) {
-    return Value(new Pair(car, cdr));
+    return Value(std::allocate_shared<Pair>(PoolAllocator<Pair, PairSpace>(), car, cdr));
 }
 
 // Procedure
-Procedure::Procedure(const std::vector<std::string> &xs, const Expr &e, const Assoc &env)
-    : ValueBase(V_PROC), parameters(xs), e(e), env(env) {}
+ProcedureCode::ProcedureCode(const std::vector<std::string> &xs, const Expr &e)
+    : parameters(xs), arity(xs.size()), body(e) {}
+
+ProcedureCode::~ProcedureCode() {
+    jitForget(body.get());
+}
+
+Procedure::Procedure(const CodeRef &code, const Assoc &env)
+    : ValueBase(V_PROC), code(code), env(env) {}
+
+Procedure::~Procedure() {
+    deferRelease(env.ptr);
+    drainReleases(release_batch);
+}
 
 void Procedure::show(std::ostream &os) {
     os << "#<procedure>";
 }
 
-Value ProcedureV(const std::vector<std::string> &xs, const Expr &e, const Assoc &env) {
-    return Value(new Procedure(xs, e, env));
+Value ProcedureV(const CodeRef &code, const Assoc &env) {
+    return Value(std::allocate_shared<Procedure>(PoolAllocator<Procedure>(), code, env));
+}
+
+// ErrorObject
+ErrorObject::ErrorObject(const std::string &msg, const Value &irritants)
+    : ValueBase(V_ERROR), message(msg), irritants(irritants) {}
+
+void ErrorObject::show(std::ostream &os) {
+    os << "#<error>";
+}
+
+Value ErrorObjectV(const std::string &msg, const Value &irritants) {
+    return Value(new ErrorObject(msg, irritants));
+}
+
+// Box
+Box::Box(const Value &v) : ValueBase(V_BOX), content(v) {}
+
+void Box::show(std::ostream &os) {
+    os << "#<box>";
+}
+
+Value BoxV(const Value &v) {
+    return Value(std::allocate_shared<Box>(PoolAllocator<Box>(), v));
+}
+
+// ============================================================================
+// Equivalence
+// ============================================================================
+
+static bool eqvBase(ValueBase *x, ValueBase *y) {
+    if (x == y) return true;
+    if (x->v_type == V_INT || x->v_type == V_RATIONAL) {
+        if (y->v_type != V_INT && y->v_type != V_RATIONAL) return false;
+        int xn = x->v_type == V_INT ? static_cast<Integer*>(x)->n : static_cast<Rational*>(x)->numerator;
+        int xd = x->v_type == V_INT ? 1 : static_cast<Rational*>(x)->denominator;
+        int yn = y->v_type == V_INT ? static_cast<Integer*>(y)->n : static_cast<Rational*>(y)->numerator;
+        int yd = y->v_type == V_INT ? 1 : static_cast<Rational*>(y)->denominator;
+        return xn == yn && xd == yd;    // Rationals are kept reduced
+    }
+    if (x->v_type != y->v_type) return false;
+    switch (x->v_type) {
+        case V_BOOL: return static_cast<Boolean*>(x)->b == static_cast<Boolean*>(y)->b;
+        case V_SYM: return static_cast<Symbol*>(x)->s == static_cast<Symbol*>(y)->s;
+        case V_NULL:
+        case V_VOID: return true;
+        default: return false;
+    }
+}
+
+bool isEqv(const Value &a, const Value &b) {
+    return eqvBase(a.get(), b.get());
+}
+
+namespace {
+
+/// Pairs visited before the walk starts recording them
+const size_t EQUAL_FAST_PAIRS = 1000;
+
+/**
+ * @brief Union-find over pairs assumed equal during one equal? walk
+ */
+struct PairClasses {
+    std::unordered_map<ValueBase*, ValueBase*> parent;
+
+    ValueBase *root(ValueBase *p) {
+        while (true) {
+            auto it = parent.find(p);
+            if (it == parent.end()) return p;
+            auto up = parent.find(it->second);
+            if (up != parent.end()) it->second = up->second;    // Path halving
+            p = it->second;
+        }
+    }
+
+    /// Join the classes of x and y; false if they were already one
+    bool unite(ValueBase *x, ValueBase *y) {
+        ValueBase *rx = root(x), *ry = root(y);
+        if (rx == ry) return false;
+        parent[rx] = ry;
+        return true;
+    }
+};
+
+/**
+ * @brief One equal? walk; classes null means no cycle detection
+ *
+ * Returns 1 if equal, 0 if not, and -1 if the walk visited budget pairs
+ * without finishing.
+ */
+int equalWalk(const Value &a, const Value &b, PairClasses *classes, size_t budget) {
+    std::vector<std::pair<ValueBase*, ValueBase*>> stack;
+    stack.push_back(std::make_pair(a.get(), b.get()));
+    while (!stack.empty()) {
+        ValueBase *x = stack.back().first, *y = stack.back().second;
+        stack.pop_back();
+        if (x == y) continue;
+        if (x->v_type == V_PAIR && y->v_type == V_PAIR) {
+            if (classes != nullptr) {
+                if (!classes->unite(x, y)) continue;
+            } else if (budget-- == 0) {
+                return -1;
+            }
+            Pair *px = static_cast<Pair*>(x), *py = static_cast<Pair*>(y);
+            stack.push_back(std::make_pair(px->cdr.get(), py->cdr.get()));
+            stack.push_back(std::make_pair(px->car.get(), py->car.get()));
+        } else if (x->v_type == V_STRING && y->v_type == V_STRING) {
+            if (static_cast<String*>(x)->s != static_cast<String*>(y)->s) return 0;
+        } else if (!eqvBase(x, y)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+}
+
+bool isEqual(const Value &a, const Value &b) {
+    int result = equalWalk(a, b, nullptr, EQUAL_FAST_PAIRS);
+    if (result >= 0) return result == 1;
+    PairClasses classes;
+    return equalWalk(a, b, &classes, 0) == 1;
 }
 
 // ============================================================================
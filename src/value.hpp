@@ -24,10 +24,11 @@
  */
 struct ValueBase {
     ValueType v_type;
+    bool frozen;        ///< Immortal: owned by the freeze root set, never reclaimed
     ValueBase(ValueType);
     virtual void show(std::ostream &) = 0;
     virtual void showCdr(std::ostream &);
-    virtual ~ValueBase() = default;
+    virtual ~ValueBase();
 };
 
 /**
@@ -36,6 +37,7 @@ struct ValueBase {
 struct Value {
     std::shared_ptr<ValueBase> ptr;
     Value(ValueBase *);
+    Value(const std::shared_ptr<ValueBase> &);
     void show(std::ostream &);
     ValueBase* operator->() const;
     ValueBase& operator*();
@@ -52,6 +54,7 @@ struct Value {
 struct Assoc {
     std::shared_ptr<AssocList> ptr;
     Assoc(AssocList *);
+    Assoc(const std::shared_ptr<AssocList> &);
     AssocList* operator->() const;
     AssocList& operator*();
     AssocList* get() const;
@@ -65,6 +68,7 @@ struct AssocList {
     Value v;            ///< Variable value
     Assoc next;         ///< Next binding in the chain
     AssocList(const std::string &, const Value &, Assoc &);
+    ~AssocList();
 };
 
 // Environment operations
@@ -73,6 +77,85 @@ Assoc extend(const std::string&, const Value &, Assoc &);
 void modify(const std::string&, const Value &, Assoc &);
 Value find(const std::string &, Assoc &);
 
+// ============================================================================
+// Undo Journal
+// ============================================================================
+
+/**
+ * @brief Record of a mutable slot and the value it held before a write
+ *
+ * While a journal is open, every in-place mutation (binding updates through
+ * modify(), set-car!, set-cdr!) logs the slot so it can be restored later.
+ * The owner keeps the node holding the slot alive until the entry is dropped.
+ */
+struct JournalEntry {
+    std::shared_ptr<void> owner;   ///< Node that owns the slot
+    Value *slot;                   ///< Mutated slot
+    Value old;                     ///< Value held before the write
+};
+
+size_t journalBegin();
+void journalRollback(size_t);
+void journalEnd();
+void journalWrite(const std::shared_ptr<void> &, Value &, const Value &);
+
+/**
+ * @brief A saved environment head and the journal position it was taken at
+ *
+ * Bindings added after a checkpoint are only reachable from newer heads, so
+ * restoring the head drops them; in-place writes are undone from the journal.
+ * Taking a checkpoint is O(1) and restoring costs only the writes made since.
+ */
+struct JournalCheckpoint {
+    size_t mark;    ///< Journal position when the checkpoint was taken
+    Assoc env;      ///< Environment head when the checkpoint was taken
+};
+
+extern unsigned env_epoch;     ///< Bumped whenever an older environment head is restored
+
+size_t checkpointCreate(const Assoc &);
+Assoc checkpointRestore(size_t);
+size_t checkpointCount();
+void checkpointDrop(size_t);
+
+// ============================================================================
+// Freezing
+// ============================================================================
+
+void freezeEnv(Assoc &);
+
+// ============================================================================
+// Deferred Release
+// ============================================================================
+
+/**
+ * @brief Objects whose last owner has died, waiting to be destroyed
+ *
+ * Destroying a Pair, AssocList or Procedure does not release what it
+ * points to recursively. Each child it owned alone is moved to a queue
+ * that the outermost destructor drains in a loop, so dropping a long
+ * list or environment chain takes constant stack.
+ *
+ * With release_batch nonzero, a destructor destroys at most that many
+ * queued objects and leaves the rest queued. The REPL drains whatever is
+ * left between forms, after the form's output has been written, and the
+ * server after each request.
+ */
+extern size_t release_batch;    ///< Objects destroyed per release, 0 for all
+
+/**
+ * @brief Destroy up to limit queued objects (0 for all); returns how many
+ */
+size_t drainReleases(size_t limit);
+
+/**
+ * @brief Never destroy released objects from now on
+ *
+ * For a process about to exit: the heap is left to the operating system
+ * and tearing down the remaining values only costs time.
+ */
+void skipTeardown();
+
 // ============================================================================
 // Simple Value Types
 // ============================================================================
@@ -171,22 +254,84 @@ struct Pair : ValueBase {
     Value car;  ///< First element
     Value cdr;  ///< Second element
     Pair(const Value &, const Value &);
+    ~Pair();
     virtual void show(std::ostream &) override;
     virtual void showCdr(std::ostream &) override;
 };
 Value PairV(const Value &, const Value &);
 
 /**
- * @brief Procedure (function) value
+ * @brief Code of a procedure: everything about it but its environment
+ *
+ * Immutable once made. Every procedure a lambda evaluates to shares the
+ * lambda's one ProcedureCode, so making a closure copies no parameter list.
  */
-struct Procedure : ValueBase {
+struct ProcedureCode {
     std::vector<std::string> parameters;   ///< Parameter names
-    Expr e;                                ///< Function body expression
+    size_t arity;                          ///< parameters.size()
+    Expr body;                             ///< Function body expression
+    ProcedureCode(const std::vector<std::string> &, const Expr &);
+    ~ProcedureCode();
+};
+typedef std::shared_ptr<const ProcedureCode> CodeRef;
+
+/**
+ * @brief Procedure (function) value: shared code plus a closure environment
+ */
+struct Procedure : ValueBase {
+    CodeRef code;                          ///< Parameters and body
     Assoc env;                             ///< Closure environment
-    Procedure(const std::vector<std::string> &, const Expr &, const Assoc &);
+    Procedure(const CodeRef &, const Assoc &);
+    ~Procedure();
     virtual void show(std::ostream &) override;
 };
-Value ProcedureV(const std::vector<std::string> &, const Expr &, const Assoc &);
+Value ProcedureV(const CodeRef &, const Assoc &);
+
+/**
+ * @brief Error object created by (error msg irritant...) or by a failing primitive
+ */
+struct ErrorObject : ValueBase {
+    std::string message;    ///< Error message
+    Value irritants;        ///< List of irritants
+    ErrorObject(const std::string &, const Value &);
+    virtual void show(std::ostream &) override;
+};
+Value ErrorObjectV(const std::string &, const Value &);
+
+/**
+ * @brief Mutable cell holding a local variable that is the target of set!
+ *
+ * Introduced by convertAssignments() (optimize.hpp). Programs never see a
+ * box: BoxRef and BoxSet read and write through it.
+ */
+struct Box : ValueBase {
+    Value content;
+    Box(const Value &);
+    virtual void show(std::ostream &) override;
+};
+Value BoxV(const Value &);
+
+// ============================================================================
+// Equivalence
+// ============================================================================
+
+/**
+ * @brief eqv?: identity, or the same number, boolean, symbol or empty object
+ *
+ * An integer and a rational are eqv? when they denote the same number.
+ */
+bool isEqv(const Value &, const Value &);
+
+/**
+ * @brief equal?: eqv?, or pairs and strings with equal contents
+ *
+ * Walks both structures with an explicit stack, so long lists cost no C++
+ * recursion. A walk that visits many pairs restarts with a union-find of
+ * pairs already assumed equal, so it also ends on cyclic structures: two
+ * pairs in the same class are not compared again. member, assoc and any
+ * later table keyed by equal? use this one kernel.
+ */
+bool isEqual(const Value &, const Value &);
 
 // ============================================================================
 // Utility Functions